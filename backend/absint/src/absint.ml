@@ -173,10 +173,30 @@ let join man s1 s2 =
     mem_counter = max s1.mem_counter s2.mem_counter;
   }
 
-let widening man s1 s2 =
+(* The constraints x <= c and x >= c, for every variable x of the
+   environment and every threshold c *)
+let threshold_array env thresholds =
+  let (ivars, rvars) = Environment.vars env in
+  let mk var coeff cst =
+    let e = Linexpr1.make env in
+    Linexpr1.set_coeff e var (Coeff.s_of_int coeff);
+    Linexpr1.set_cst e (Coeff.s_of_int cst);
+    Lincons1.make e Lincons1.SUPEQ
+  in
+  let cons =
+    List.concat_map (fun var ->
+        List.concat_map (fun c -> [mk var (-1) c; mk var 1 (-c)]) thresholds
+      ) (Array.to_list ivars @ Array.to_list rvars)
+  in
+  let ear = Lincons1.array_make env (List.length cons) in
+  List.iteri (Lincons1.array_set ear) cons;
+  ear
+
+let widening man thresholds s1 s2 =
   (* TODO/NOTE: this is wrong, it ignores non scalar terms *)
   let (s1, s2) = lift_common_env man (s1, s2) in
-  { abs_scalar = Abstract1.widening man s1.abs_scalar s2.abs_scalar;
+  let ear = threshold_array (Abstract1.env s1.abs_scalar) thresholds in
+  { abs_scalar = Abstract1.widening_threshold man s1.abs_scalar s2.abs_scalar ear;
     abs_term =
       SMap.union (fun k v _ -> Some v) (* TODO *)
         s1.abs_term s2.abs_term;
@@ -348,7 +368,7 @@ let rec absvalue_of_texpr ~with_sym core man = function
     assert false
 
 and absvalue_of_action ~with_sym core man = function
-  | TAcreate ->
+  | TAcreate _ ->
     modify (fun s ->
           (ATpointer (APconcrete s.mem_counter),
            { s with mem_counter = s.mem_counter + 1 })
@@ -679,16 +699,76 @@ let apply core man g e st =
        print_endline "non_empty");
     s
 
+(* Widening thresholds: the integer constants compared against in the guards
+   of the CFG and the sizes of the arrays it creates, with their neighbours
+   (loop bounds are usually off by one from them) *)
+module ISet = Set.Make(Int)
+
+(* only harvesting the constants strictly inside the range of int, so that
+   they and their neighbours can be thresholds (N.to_int would overflow) *)
+let add_constant n acc =
+  if N.less (N.of_int min_int) n && N.less n (N.of_int max_int) then
+    ISet.add (N.to_int n) acc
+  else
+    acc
+
+let rec texpr_constants acc = function
+  | TEval (Vobject (OVinteger i))
+  | TEval (Vloaded (LVspecified (OVinteger i))) ->
+    Impl_mem.case_integer_value i
+      (fun n -> add_constant n acc)
+      (fun _ -> acc)
+  | TEop (_, te1, te2) ->
+    texpr_constants (texpr_constants acc te1) te2
+  | TEnot te ->
+    texpr_constants acc te
+  | TEcall (_, tes) ->
+    List.fold_left texpr_constants acc tes
+  | _ ->
+    acc
+
+let rec cond_constants acc = function
+  | Cop (_, te1, te2) ->
+    texpr_constants (texpr_constants acc te1) te2
+  | Cnot c ->
+    cond_constants acc c
+  | _ ->
+    acc
+
+let rec ctype_constants acc (Ctype.Ctype (_, ty)) =
+  match ty with
+  | Ctype.Array (elem_ty, Some n) ->
+    ctype_constants (add_constant n acc) elem_ty
+  | Ctype.Array (elem_ty, None) ->
+    ctype_constants acc elem_ty
+  | _ ->
+    acc
+
+let thresholds_of_cfg g =
+  let cs =
+    Pgraph.fold_edge (fun _ (_, tr, _) acc ->
+        match tr with
+        | Tcond c -> cond_constants acc c
+        | Tassign (_, TEaction (TAcreate (Some ty))) -> ctype_constants acc ty
+        | _ -> acc
+      ) g ISet.empty
+  in
+  ISet.fold (fun n acc -> ISet.add (n-1) (ISet.add (n+1) acc)) cs cs
+  |> ISet.elements
+
 module F = Fixpoint.Make (struct type 'a t = 'a absstate end)
 open F
 
 let make_lattice core man g =
+  let thresholds = thresholds_of_cfg g in
+  debug @@ "Widening thresholds: "
+    ^ String.concat ", " (List.map string_of_int thresholds);
   { bottom = (fun vtx -> bot man);
     is_bottom = (fun vtx -> is_bottom man);
     is_leq = (fun vtx -> is_leq man);
     join = (fun vst -> join man);
     join_list = (fun vtx abs_s -> List.fold_left (join man) (bot man) abs_s);
-    widening = (fun vtx abs1 abs2 -> widening man abs1 abs2);
+    widening = (fun vtx abs1 abs2 -> widening man thresholds abs1 abs2);
     init = (fun vtx -> init_absstate man);
     apply = (fun e st -> apply core man g e st);
   }
@@ -10,8 +10,8 @@ end
 module Sym = struct
   type t = Symbol.sym
   let compare (Symbol.Symbol (d1, n1, _)) (Symbol.Symbol (d2, n2, _)) =
-    if d1 = d2 then compare n1 n2
-    else Digest.compare d1 d2
+    if Stdlib.Int.equal d1 d2 then Stdlib.Int.compare n1 n2
+    else Stdlib.Int.compare d1 d2
   let show (Symbol.Symbol (_, n, sd)) =
     let open Symbol in
     let descr = function
@@ -148,7 +148,7 @@ type ('a, 'bty) texpr =
   | TEare_compatible of ('a, 'bty) texpr * ('a, 'bty) texpr
 
 and ('a, 'bty) taction =
-  | TAcreate
+  | TAcreate of ctype option (* the type of the object, when it is a constant *)
   | TAalloc
   | TAkill of ('a, 'bty) texpr
   | TAstore of ('a, 'bty) texpr * ('a, 'bty) texpr
@@ -353,7 +353,7 @@ let rec show_texpr te =
     "are_compatible" ^ parens (self te1 ^ ", " ^ self te2)
 
 and show_taction = function
-  | TAcreate -> "create"
+  | TAcreate _ -> "create"
   | TAalloc -> "alloc"
   | TAstore (p, v) -> "store" ^ parens (show_texpr p ^ ", " ^ show_texpr v)
   | TAload p -> "load" ^ parens (show_texpr p)
@@ -738,10 +738,12 @@ let add_action (in_v, out_v) in_pat (Action (_, _, act_)) =
   let open GraphM in
   let add (v1, v2) t = add_edge (v1, v2) t >>= fun () -> return `OK in
   match act_ with
-  | Create _ ->
-    add (in_v, out_v) (Tassign (in_pat, TEaction TAcreate))
+  | Create (_, Pexpr (_, _, PEval (Vctype ty)), _)
+  | CreateReadOnly (_, Pexpr (_, _, PEval (Vctype ty)), _, _) ->
+    add (in_v, out_v) (Tassign (in_pat, TEaction (TAcreate (Some ty))))
+  | Create _
   | CreateReadOnly _ ->
-    add (in_v, out_v) (Tassign (in_pat, TEaction TAcreate))
+    add (in_v, out_v) (Tassign (in_pat, TEaction (TAcreate None)))
   | Alloc0 _ ->
     add (in_v, out_v) (Tassign (in_pat, TEaction TAalloc))
   | Kill (_, pe) ->
@@ -1059,7 +1061,7 @@ let mk_dot ?(sequentialise=false) output_filename core =
   let cfg = mk_cfg ~sequentialise core in
   let oc = open_out @@ output_filename ^ ".cfg" in
   output_string oc "digraph G {\n";
-  dot_of_proc oc (Symbol.Symbol ("", 0, SD_Id "globs")) (snd cfg.globs);
+  dot_of_proc oc (Symbol.Symbol (0, 0, SD_Id "globs")) (snd cfg.globs);
   Pmap.iter (fun nm f ->
       match f with
       | Tgraph (_, _, g) ->
@@ -63,8 +63,9 @@ struct
     { graph: ('a vertex_attr, edge_attr) graph;
       opers: 'a t;
       vinit: vertex_id;
-      widening_start: int;          (* iterations until start widening *)
-      widening_descend: int;
+      widening_delay: int;          (* times a loop head grows before it is widened *)
+      head_counters: (vertex_id, int) Pmap.map; (* per loop head *)
+      narrowing_max: int;           (* bound on the descending iterations *)
       workset: vertex_id Pset.set;
     }
 
@@ -101,13 +102,19 @@ struct
     get >>= fun st ->
     return @@ Pset.cardinal st.workset
 
-  let widening_start () =
+  (* Counts a growth of loop head v, returns whether it has to be widened *)
+  let count_head v =
     get >>= fun st ->
-    return st.widening_start
+    let n = match Pmap.lookup v st.head_counters with
+      | Some n -> n + 1
+      | None -> 1
+    in
+    put { st with head_counters = Pmap.add v n st.head_counters } >>
+    return (n > st.widening_delay)
 
-  let widening_descend () =
+  let narrowing_max () =
     get >>= fun st ->
-    return st.widening_descend
+    return st.narrowing_max
 
   let attr_of_vertex v =
     get >>= fun st ->
@@ -228,9 +235,11 @@ struct
         ) stgy (return reducing)
       >>= fun reducing ->
       cardinal_workset () >>= fun card ->
-      widening_descend () >>= fun wd ->
+      narrowing_max () >>= fun nmax ->
+      (* stops once stable, the bound only guards against infinite
+         decreasing chains *)
       let reducing = reducing && card > 0 in
-      if reducing && counter < wd then
+      if reducing && counter < nmax then
         loop (reducing,counter)
       else
         return ()
@@ -238,8 +247,8 @@ struct
 
   let descend stgy =
     debug "Descending...";
-    widening_descend () >>= fun wd ->
-    checkM (return (wd > 0)) begin fun () ->
+    narrowing_max () >>= fun nmax ->
+    checkM (return (nmax > 0)) begin fun () ->
       get_workset () >>= fun old_ws ->
       Nested_list.fold (fun n wsM ->
           wsM >>= fun ws ->
@@ -257,13 +266,14 @@ struct
     end
 
   (* Run strategy point. *)
-  let run_point ~widen p =
+  let run_point p =
     debug ("Processing v: " ^ string_of_int p.vertex);
     attr_of_vertex p.vertex >>= fun old_attr ->
     propagate ~descend:false p >>
     checkM (is_growing p.vertex old_attr) begin fun () ->
       update_workset p.vertex >>= fun () ->
-      whenM (return (widen && p.widen && not old_attr.is_bot))
+      whenM (if p.widen && not old_attr.is_bot then count_head p.vertex
+             else return false)
             (fun () -> widening p.vertex old_attr.abstract) >>
       return true
     end
@@ -271,25 +281,22 @@ struct
   (* Run strategy point list. *)
   let rec run_list ~depth stgy =
     assert (depth >= 2);
-    let aux ~widen = function
+    let aux = function
       | Atom n ->
-        checkM (mem_workset n.vertex) (fun () -> run_point ~widen n)
+        checkM (mem_workset n.vertex) (fun () -> run_point n)
       | List stgy ->
         run_list ~depth:(depth+1) stgy
     in
-    let rec iterate growing ~widen = function
+    let rec iterate growing = function
       | [] ->
         return growing
       | x::xs ->
-        aux ~widen x >>= fun res ->
-        iterate (growing || res) ~widen xs
+        aux x >>= fun res ->
+        iterate (growing || res) xs
     in
     (* iterate until stabilization *)
-    let rec loop (acc_growing, counter) =
-      let counter = counter + 1 in
-      widening_start () >>= fun ws ->
-      let widen = (counter >= ws) in
-      iterate false ~widen stgy >>= fun growing ->
+    let rec loop acc_growing =
+      iterate false stgy >>= fun growing ->
       begin if growing (*&& depth >= 3*) then
         Nested_list.fold (fun n repeatM ->
             ifM repeatM
@@ -300,17 +307,17 @@ struct
           return false
       end >>= function
       | true ->
-        loop (acc_growing || growing, counter)
+        loop (acc_growing || growing)
       | false ->
         return (acc_growing || growing)
-    in loop (false, 0)
+    in loop false
 
   (* Run top strategy *)
   (* NOTE: No need to stabilize. *)
   let run_top_strategy stgy =
     let aux = function
       | Atom p ->
-        checkM (mem_workset p.vertex) (fun () -> run_point ~widen:false p)
+        checkM (mem_workset p.vertex) (fun () -> run_point p)
         >>= fun growing -> return (growing, false)
       | List stgy ->
         run_list ~depth:2 stgy >>= fun growing ->
@@ -334,8 +341,9 @@ struct
     let graph = Pgraph.map add_attr (fun _ _ -> true) g in
     { graph; vinit = v0;
       opers = l;
-      widening_start = 0;
-      widening_descend = 1;
+      widening_delay = 1;
+      head_counters = Pmap.empty compare;
+      narrowing_max = 10;
       workset = Pset.empty compare;
     }
 
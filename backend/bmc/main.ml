@@ -255,7 +255,7 @@ let cerberus debug_level progress core_obj
         if exec then
           let open Driver_ocaml in
           let () = Tags.set_tagDefs core_file.tagDefs in
-          let driver_conf = {concurrency; exec_mode; fs_dump; trace} in
+          let driver_conf = {concurrency; exec_mode; fs_dump; trace; evaluator= Reference} in
           interp_backend io core_file ~args ~batch ~fs ~driver_conf
         else
           match output_name with
@@ -86,9 +86,13 @@ let frontend ~macros ~incl_dirs ~incl_files astprints ~filename ~magic_comment_c
   let cabs_tunit = Option.get cabs_tunit_opt in
   let markers_env, ail_prog = Option.get ail_prog_opt in
   Tags.set_tagDefs prog0.Core.tagDefs;
-  let prog1 = Remove_unspecs.rewrite_file prog0 in
-  let prog2 = Milicore.core_to_micore__file Locations.update prog1 in
-  let prog3 = Milicore_label_inline.rewrite_file prog2 in
+  let prog1, prog3 =
+    Cerb_metrics.time_phase "core_rewrites" (fun () ->
+      let prog1 = Remove_unspecs.rewrite_file prog0 in
+      let prog2 = Milicore.core_to_micore__file Locations.update prog1 in
+      let prog3 = Milicore_label_inline.rewrite_file prog2 in
+      (prog1, prog3))
+  in
   let statement_locs = CStatements.search (snd ail_prog) in
   print_log_file ("original", CORE prog0);
   print_log_file ("without_unspec", CORE prog1);
@@ -129,6 +133,7 @@ let with_well_formedness_check
   ~coq_proof_log
   ~csv_times
   ~log_times
+  ~bench_metrics
   ~astprints
   ~no_inherit_loc
   ~magic_comment_char_dollar
@@ -143,6 +148,11 @@ let with_well_formedness_check
      unit Or_TypeError.t)
   =
   check_input_file filename;
+  Option.iter
+    (fun file ->
+      Cerb_metrics.enabled := true;
+      at_exit (fun () -> Cerb_metrics.output_file file))
+    bench_metrics;
   let cabs_tunit, prog, (markers_env, ail_prog), statement_locs =
     handle_frontend_error
       (frontend
@@ -163,14 +173,16 @@ let with_well_formedness_check
     let result =
       let open Or_TypeError in
       let@ prog5 =
-        Core_to_mucore.normalise_file
-          ~inherit_loc:(not no_inherit_loc)
-          (markers_env, snd ail_prog)
-          prog
+        Cerb_metrics.time_phase "core_to_mucore" (fun () ->
+          Core_to_mucore.normalise_file
+            ~inherit_loc:(not no_inherit_loc)
+            (markers_env, snd ail_prog)
+            prog)
       in
       print_log_file ("mucore", MUCORE prog5);
       let paused =
-        Typing.run_to_pause Context.empty (Check.check_decls_lemmata_fun_specs prog5)
+        Cerb_metrics.time_phase "wf_check" (fun () ->
+          Typing.run_to_pause Context.empty (Check.check_decls_lemmata_fun_specs prog5))
       in
       Result.iter_error handle_error (Typing.pause_to_result paused);
       let@ _ = f ~cabs_tunit ~prog5 ~ail_prog ~statement_locs ~paused in
@@ -249,6 +261,7 @@ let well_formed
   output_dir
   csv_times
   log_times
+  bench_metrics
   astprints
   no_inherit_loc
   magic_comment_char_dollar
@@ -262,6 +275,7 @@ let well_formed
     ~coq_proof_log:false
     ~csv_times
     ~log_times
+    ~bench_metrics
     ~astprints
     ~no_inherit_loc
     ~magic_comment_char_dollar
@@ -291,10 +305,17 @@ let verify
   skip
   csv_times
   log_times
+  bench_metrics
   solver_logging
   solver_flags
   solver_path
   solver_type
+  solver_timeout
+  solver_rlimit
+  solver_retry_unknown
+  solver_inline_defs
+  solver_int_encoding
+  solver_int_encoding_for
   astprints
   dont_use_vip
   no_use_ity
@@ -323,12 +344,18 @@ let verify
   Solver.solver_path := solver_path;
   Solver.solver_type := solver_type;
   Solver.solver_flags := solver_flags;
+  Solver.query_timeout := solver_timeout;
+  Solver.query_rlimit := solver_rlimit;
+  Solver.retry_unknown := solver_retry_unknown;
+  Solver.inline_definitions := solver_inline_defs;
+  Solver.int_encoding := solver_int_encoding;
+  Check.int_encoding_functions := opt_comma_split solver_int_encoding_for;
   Check.skip_and_only := (opt_comma_split skip, opt_comma_split only);
-  IndexTerms.use_vip := not dont_use_vip;
+  IndexTerms.set_use_vip (not dont_use_vip);
   Check.fail_fast := fail_fast;
   Diagnostics.diag_string := diag;
   WellTyped.use_ity := not no_use_ity;
-  Resource.disable_resource_derived_constraints := disable_resource_derived_constraints;
+  Resource.set_disable_resource_derived_constraints disable_resource_derived_constraints;
   (* Set the prooflog flag based on --coq-proof-log *)
   Prooflog.set_enabled coq_proof_log;
   with_well_formedness_check (* CLI arguments *)
@@ -340,6 +367,7 @@ let verify
     ~coq_proof_log
     ~csv_times
     ~log_times
+    ~bench_metrics
     ~astprints
     ~no_inherit_loc
     ~magic_comment_char_dollar
@@ -422,7 +450,7 @@ let generate_executable_specs
   CF.Pp_symbol.pp_cn_sym_nums := print_sym_nums;
   Pp.print_timestamps := not no_timestamps;
   Check.skip_and_only := (opt_comma_split skip, opt_comma_split only);
-  IndexTerms.use_vip := not dont_use_vip;
+  IndexTerms.set_use_vip (not dont_use_vip);
   Check.fail_fast := fail_fast;
   Diagnostics.diag_string := diag;
   WellTyped.use_ity := not no_use_ity;
@@ -436,6 +464,7 @@ let generate_executable_specs
     ~coq_proof_log:false
     ~csv_times
     ~log_times
+    ~bench_metrics:None
     ~astprints
     ~no_inherit_loc
     ~magic_comment_char_dollar (* Callbacks *)
@@ -503,6 +532,7 @@ let run_seq_tests
     ~coq_export_file:None
     ~coq_proof_log:false
     ~log_times
+    ~bench_metrics:None
     ~astprints
     ~no_inherit_loc
     ~magic_comment_char_dollar (* Callbacks *)
@@ -620,6 +650,7 @@ let run_tests
     ~coq_export_file:None
     ~coq_proof_log:false
     ~log_times
+    ~bench_metrics:None
     ~astprints
     ~no_inherit_loc
     ~magic_comment_char_dollar (* Callbacks *)
@@ -787,6 +818,14 @@ module Common_flags = struct
     Arg.(value & opt (some string) None & info [ "log-times" ] ~docv:"FILE" ~doc)
 
 
+  let bench_metrics =
+    let doc =
+      "file in which to output per-phase benchmark metrics (timings, allocations, SMT \
+       queries, resource inference steps) as JSON"
+    in
+    Arg.(value & opt (some string) None & info [ "bench-metrics" ] ~docv:"FILE" ~doc)
+
+
   (* copy-pasting from backend/driver/main.ml *)
   let astprints =
     let doc =
@@ -872,6 +911,52 @@ module Verify_flags = struct
       & info [ "solver-type" ] ~docv:"z3|cvc5" ~doc)
 
 
+  let solver_timeout =
+    let doc =
+      "Time limit for each solver query, in milliseconds. A query that runs out of time \
+       fails the check of the enclosing function with an 'unknown' outcome."
+    in
+    Arg.(value & opt (some int) None & info [ "solver-timeout" ] ~docv:"MS" ~doc)
+
+
+  let solver_rlimit =
+    let doc = "Resource limit for each solver query (solver specific)" in
+    Arg.(value & opt (some int) None & info [ "solver-rlimit" ] ~docv:"N" ~doc)
+
+
+  let solver_retry_unknown =
+    let doc =
+      "Retry a query that ran out of time once, with four times the time limit (Z3 only)"
+    in
+    Arg.(value & flag & info [ "solver-retry-unknown" ] ~doc)
+
+
+  let solver_inline_defs =
+    let doc =
+      "Inline the bodies of non-recursive logical functions at each call in solver \
+       queries, instead of defining them once"
+    in
+    Arg.(value & flag & info [ "solver-inline-defs" ] ~doc)
+
+
+  let solver_int_encoding =
+    let doc =
+      "Encode C integer values as SMT integers (with explicit wrap-around) rather than \
+       bit-vectors. This is often faster for arithmetic-heavy code. Integers read \
+       from maps, lists, datatypes and uninterpreted functions are clamped into range \
+       where they are read, so equalities between such aggregates may be unprovable."
+    in
+    Arg.(value & flag & info [ "solver-int-encoding" ] ~doc)
+
+
+  let solver_int_encoding_for =
+    let doc =
+      "Use the encoding of --solver-int-encoding for this function only (or \
+       comma-separated names)"
+    in
+    Arg.(value & opt (some string) None & info [ "solver-int-encoding-for" ] ~doc)
+
+
   let only =
     let doc = "only type-check this function (or comma-separated names)" in
     Arg.(value & opt (some string) None & info [ "only" ] ~doc)
@@ -987,6 +1072,7 @@ let wf_cmd =
     $ Verify_flags.output_dir
     $ Common_flags.csv_times
     $ Common_flags.log_times
+    $ Common_flags.bench_metrics
     $ Common_flags.astprints
     $ Common_flags.no_inherit_loc
     $ Common_flags.magic_comment_char_dollar
@@ -1027,10 +1113,17 @@ let verify_t : unit Term.t =
   $ Verify_flags.skip
   $ Common_flags.csv_times
   $ Common_flags.log_times
+  $ Common_flags.bench_metrics
   $ Verify_flags.solver_logging
   $ Verify_flags.solver_flags
   $ Verify_flags.solver_path
   $ Verify_flags.solver_type
+  $ Verify_flags.solver_timeout
+  $ Verify_flags.solver_rlimit
+  $ Verify_flags.solver_retry_unknown
+  $ Verify_flags.solver_inline_defs
+  $ Verify_flags.solver_int_encoding
+  $ Verify_flags.solver_int_encoding_for
   $ Common_flags.astprints
   $ Verify_flags.dont_use_vip
   $ Common_flags.no_use_ity
@@ -430,7 +430,7 @@ let check_against_core_bt loc msg2 cbt bt =
 
 
 let check_has_alloc_id loc ptr ub_unspec =
-  if !use_vip then
+  if use_vip () then
     let@ provable = provable loc in
     match provable (LC.T (hasAllocId_ ptr loc)) with
     | `True -> return ()
@@ -472,7 +472,7 @@ let check_both_eq_alloc loc arg1 arg2 ub =
 
 (** If [ptrs] has more than one element, the allocation IDs must be equal *)
 let check_live_alloc_bounds ?(skip_live = false) reason loc ub ptrs =
-  if !use_vip then
+  if use_vip () then
     let@ () =
       if skip_live then
         return ()
@@ -1267,11 +1267,11 @@ let instantiate loc filter arg =
   let arg_it = sym_ (arg_s, IT.get_bt arg, loc) in
   let@ () = add_l arg_s (IT.get_bt arg_it) (loc, lazy (Sym.pp arg_s)) in
   let@ () = add_c loc (LC.T (eq__ arg_it arg loc)) in
-  let@ constraints = get_cs () in
+  let@ constraints = get_quantified_cs () in
   let extra_assumptions1 =
     List.filter_map
       (function LC.Forall ((s, bt), t) when filter t -> Some ((s, bt), t) | _ -> None)
-      (LC.Set.elements constraints)
+      (List.rev constraints)
   in
   let extra_assumptions2, type_mismatch =
     List.partition (fun ((_, bt), _) -> BT.equal bt (IT.get_bt arg_it)) extra_assumptions1
@@ -1657,9 +1657,9 @@ let rec check_expr labels (e : BT.t Mu.expr) (k : IT.t -> unit m) : unit m =
               Alloc.History.make_value ~base:(addr_ ret here) ~size here
             in
             let@ () =
-              if !use_vip then
+              if use_vip () then
                 (* This is not backwards compatible because in the solver
-                 * Alloc_id maps to unit if not (!use_vip) *)
+                 * Alloc_id maps to unit if not (use_vip ()) *)
                 add_c loc (LC.T (eq_ (lookup, value) here))
               else
                 return ()
@@ -2239,6 +2239,10 @@ let skip_and_only = ref (([] : string list), ([] : string list))
     single function fails to verify. *)
 let fail_fast = ref false
 
+(** The functions checked with [Solver.int_encoding], in addition to all of
+    them when that is set *)
+let int_encoding_functions = ref ([] : string list)
+
 let record_tagdefs tagDefs =
   PmapM.iterM
     (fun tag def ->
@@ -2359,7 +2363,7 @@ let record_globals : 'bty. (Sym.t * 'bty Mu.globs) list -> LC.t list m =
         let ptr = sym_ (sym, bt, here) in
         let hasAllocId = LC.T (IT.hasAllocId_ ptr here) in
         let range =
-          if !IT.use_vip then
+          if IT.use_vip () then
             let module H = Alloc.History in
             let H.{ base; size } = H.(split (lookup_ptr ptr here) here) in
             let addr = addr_ ptr here in
@@ -2472,7 +2476,20 @@ let select_functions (fsyms : Sym.Set.t) : Sym.Set.t =
 
 (** Check a single C function. Failure of the check is encoded monadically. *)
 let check_c_function ((fsym, (loc, args_and_body)) : c_function) : unit m =
-  check_procedure loc fsym args_and_body
+  let int_encoding =
+    !Solver.int_encoding
+    || List.mem String.equal (Sym.pp_string fsym) !int_encoding_functions
+  in
+  time_phase
+    ("check_function:" ^ Sym.pp_string fsym)
+    (with_int_encoding
+       int_encoding
+       (catch_solver_unknown (check_procedure loc fsym args_and_body)))
+
+
+(** The verdict reported for a function whose check failed *)
+let failure_verdict (err : TypeErrors.t) =
+  match err.msg with Solver_unknown _ -> " -- unknown" | _ -> " -- fail"
 
 
 (** Check the provided C functions. The first failed check will short-circuit
@@ -2492,7 +2509,7 @@ let check_c_functions_fast (funs : c_function list) : (string * TypeErrors.t) op
          progress_simple (of_total checked total) (fn_name ^ " -- pass");
          return (checked, None)
        | Error err ->
-         progress_simple (of_total checked total) (fn_name ^ " -- fail");
+         progress_simple (of_total checked total) (fn_name ^ failure_verdict err);
          return (checked, Some (fn_name, err)))
   in
   let@ _num_checked, error = ListM.fold_leftM check_and_record (0, None) funs in
@@ -2518,7 +2535,7 @@ let check_c_functions_all (funs : c_function list) : (string * TypeErrors.t) lis
       progress_simple (of_total checked total) (fn_name ^ " -- pass");
       return (checked, errors)
     | Error err ->
-      progress_simple (of_total checked total) (fn_name ^ " -- fail");
+      progress_simple (of_total checked total) (fn_name ^ failure_verdict err);
       return (checked, (fn_name, err) :: errors)
   in
   let@ _num_checked, errors = ListM.fold_leftM check_and_record (0, []) funs in
@@ -2764,7 +2781,7 @@ let time_check_c_functions (global_var_constraints, (checked : c_function list))
       (fun (_, (loc, args_and_body)) -> Consistent.procedure loc args_and_body)
       checked
   in
-  let@ errors = check_c_functions checked in
+  let@ errors = time_phase "check_functions" (check_c_functions checked) in
   Cerb_debug.end_csv_timing "type checking functions";
   return errors
 
@@ -114,6 +114,17 @@ let generate_cn_pop_msg_info =
   [ A.(AilSexpr (mk_expr expr_)) ]
 
 
+(* Makes the runtime agree with the logging level and trace granularity the
+   instrumented code may have been compiled with (-DCN_LOGGING_LEVEL=...) *)
+let generate_logging_init_stats () =
+  let init_sym = Sym.fresh_pretty "initialise_cn_logging" in
+  [ A.(AilSexpr (mk_expr (AilEcall (mk_expr (AilEident init_sym), [])))) ]
+
+
+let cn_sampled_call_enter_sym = Sym.fresh_pretty "CN_SAMPLED_CALL_ENTER"
+
+let cn_sampled_call_exit_sym = Sym.fresh_pretty "CN_SAMPLED_CALL_EXIT"
+
 let cn_assert_sym = Sym.fresh_pretty "cn_assert"
 
 let generate_cn_assert (*?(cn_source_loc_opt = None)*) ail_expr =
@@ -3528,10 +3539,15 @@ let rec cn_to_ail_lat_internal_2
             mk_stmt (A.AilSexpr (mk_expr (AilEcall (mk_expr (AilEident fn_sym), [])))))
           OE.[ cn_stack_depth_decr_sym; cn_postcondition_leak_check_sym ]
     in
+    let sampling_exit_stat_ =
+      mk_stmt
+        A.(AilSexpr (mk_expr (AilEcall (mk_expr (AilEident cn_sampled_call_exit_sym), []))))
+    in
     let block =
       A.(
         AilSblock
-          (return_cn_binding @ post_bs, return_cn_decl @ post_ss @ ownership_stats_))
+          ( return_cn_binding @ post_bs,
+            return_cn_decl @ post_ss @ ownership_stats_ @ [ sampling_exit_stat_ ] ))
     in
     { pre = ([], []);
       post = ([], [ block ]);
@@ -3596,15 +3612,19 @@ let cn_to_ail_pre_post_internal
         c_return_type
         internal
     in
+    (* Decides whether this call is checked, see CN_SAMPLING_PERIOD in libcn *)
+    let sampling_enter_stat_ =
+      A.AilSexpr (mk_expr (AilEcall (mk_expr (AilEident cn_sampled_call_enter_sym), [])))
+    in
     let extra_stats_ =
       if without_ownership_checking then
-        []
+        [ sampling_enter_stat_ ]
       else (
         let cn_stack_depth_incr_stat_ =
           A.AilSexpr
             (mk_expr (AilEcall (mk_expr (AilEident OE.cn_stack_depth_incr_sym), [])))
         in
-        [ cn_stack_depth_incr_stat_ ])
+        [ sampling_enter_stat_; cn_stack_depth_incr_stat_ ])
     in
     prepend_to_precondition ail_executable_spec ([], extra_stats_)
   | None -> empty_ail_executable_spec
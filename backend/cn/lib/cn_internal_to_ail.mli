@@ -54,6 +54,8 @@ type ail_executable_spec =
         list
   }
 
+val generate_logging_init_stats : unit -> CF.GenTypes.genTypeCategory A.statement_ list
+
 val generate_get_or_put_ownership_function
   :  without_ownership_checking:bool ->
   C.ctype ->
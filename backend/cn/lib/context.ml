@@ -31,12 +31,24 @@ type resource_history =
     last_read_id : int
   }
 
+(* The symbols related through the constraints (transitively), as a union-find
+   with union by size: [parent] links each symbol that is not a
+   representative to another symbol of its class, and [members] maps the
+   representatives to their classes. *)
+type related =
+  { parent : Sym.t Sym.Map.t;
+    members : Sym.Set.t Sym.Map.t
+  }
+
 type t =
   { computational : (basetype_or_value * l_info) Sym.Map.t;
     logical : (basetype_or_value * l_info) Sym.Map.t;
     resources : (Res.t * int) list * int;
     resource_history : resource_history IntMap.t;
     constraints : LC.Set.t;
+    constraint_log : (int * LC.t) list;
+    quantified : LC.t list;
+    related : related;
     global : Global.t;
     where : Where.t
   }
@@ -52,6 +64,9 @@ let empty =
     resources = ([], 0);
     resource_history = IntMap.empty;
     constraints = LC.Set.empty;
+    constraint_log = [];
+    quantified = [];
+    related = { parent = Sym.Map.empty; members = Sym.Map.empty };
     global = Global.empty;
     where = Where.empty
   }
@@ -87,9 +102,9 @@ let pp (ctxt : t) =
   ^/^ item "constraints" (pp_constraints ctxt.constraints)
 
 
-let bound_a s ctxt = Sym.Map.exists (fun s' _ -> Sym.equal s s') ctxt.computational
+let bound_a s ctxt = Sym.Map.mem s ctxt.computational
 
-let bound_l s ctxt = Sym.Map.exists (fun s' _ -> Sym.equal s s') ctxt.logical
+let bound_l s ctxt = Sym.Map.mem s ctxt.logical
 
 let bound s ctxt = bound_a s ctxt || bound_l s ctxt
 
@@ -135,12 +150,67 @@ let remove_a s ctxt =
     { ctxt with computational = Sym.Map.remove s ctxt.computational }
 
 
-let add_c c (ctxt : t) =
+let rec related_root related x =
+  match Sym.Map.find_opt x related.parent with
+  | Some y -> related_root related y
+  | None -> x
+
+
+let related_class related x =
+  match Sym.Map.find_opt (related_root related x) related.members with
+  | Some xs -> xs
+  | None -> Sym.Set.singleton x
+
+
+let relate related x y =
+  let rx = related_root related x in
+  let ry = related_root related y in
+  if Sym.equal rx ry then
+    related
+  else (
+    let xs = related_class related rx in
+    let ys = related_class related ry in
+    let big, small = if Sym.Set.cardinal xs >= Sym.Set.cardinal ys then (rx, ry) else (ry, rx) in
+    { parent = Sym.Map.add small big related.parent;
+      members =
+        Sym.Map.add big (Sym.Set.union xs ys) (Sym.Map.remove small related.members)
+    })
+
+
+let related_syms ctxt syms =
+  Sym.Set.fold
+    (fun x acc -> Sym.Set.union (related_class ctxt.related x) acc)
+    syms
+    Sym.Set.empty
+
+
+(* The constraints are kept as a set, for membership checks, and as an
+   append-only log (most recent first), so the order in which they were
+   assumed is preserved and the quantified ones can be found without scanning
+   the whole set. Each entry of the log records the solver push level
+   ([level]) at which the constraint was assumed, so that a solver can be
+   brought in step with the context (see [Typing.init_solver]). *)
+let add_c ~level c (ctxt : t) =
   let s = ctxt.constraints in
   if LC.Set.mem c s then
     ctxt
-  else
-    { ctxt with constraints = LC.Set.add c s }
+  else (
+    let quantified = if LC.is_forall c then c :: ctxt.quantified else ctxt.quantified in
+    let related =
+      match Sym.Set.elements (LC.free_vars c) with
+      | [] -> ctxt.related
+      | x :: xs -> List.fold_left (fun related y -> relate related x y) ctxt.related xs
+    in
+    { ctxt with
+      constraints = LC.Set.add c s;
+      constraint_log = (level, c) :: ctxt.constraint_log;
+      quantified;
+      related
+    })
+
+
+(* in the order they were added, with their push levels *)
+let constraints_in_order ctxt = List.rev ctxt.constraint_log
 
 
 let modify_where (f : Where.t -> Where.t) ctxt = { ctxt with where = f ctxt.where }
@@ -267,9 +337,7 @@ let json (ctxt : t) : Yojson.Safe.t =
    and resource predicates that will not be given to the solver *)
 let not_given_to_solver ctxt =
   let global = ctxt.global in
-  let constraints =
-    filter LogicalConstraints.is_forall (LC.Set.elements ctxt.constraints)
-  in
+  let constraints = List.rev ctxt.quantified in
   let funs =
     Sym.Map.bindings
       (Sym.Map.filter
@@ -18,12 +18,17 @@ type resource_history =
     last_read_id : int
   }
 
+type related
+
 type t =
   { computational : (basetype_or_value * l_info) Sym.Map.t;
     logical : (basetype_or_value * l_info) Sym.Map.t;
     resources : (Resource.t * int) list * int;
     resource_history : resource_history Map.Make(Int).t;
     constraints : LogicalConstraints.Set.t;
+    constraint_log : (int * LogicalConstraints.t) list;
+    quantified : LogicalConstraints.t list;
+    related : related;
     global : Global.t;
     where : Where.t
   }
@@ -64,7 +69,14 @@ val add_l_value : Sym.t -> IndexTerms.t -> l_info -> t -> t
 
 val remove_a : Sym.t -> t -> t
 
-val add_c : LogicalConstraints.Set.elt -> t -> t
+(** [add_c ~level lc] assumes [lc] at the solver push level [level]. *)
+val add_c : level:int -> LogicalConstraints.Set.elt -> t -> t
+
+val constraints_in_order : t -> (int * LogicalConstraints.t) list
+
+(** The symbols related to the given ones through the constraints of the
+    context (transitively). *)
+val related_syms : t -> Sym.Set.t -> Sym.Set.t
 
 val modify_where : (Where.t -> Where.t) -> t -> t
 
@@ -2,46 +2,82 @@ module IT = IndexTerms
 module ITMap = Map.Make (IT)
 module ITSet = Set.Make (IT)
 
-(* operations on a table of (possibly guarded) equalities *)
-
-type eq_info =
-  { guard : IT.t option;
-    rhs : IT.t
+(* operations on a table of (possibly guarded) equalities, kept as
+   equivalence classes *)
+
+(* Persistent union-find, without path compression: every term points
+   directly at the representative of its class, and each representative
+   knows the members of its class. A merge re-points the members of the
+   smaller class, so looking up a class is a single map lookup, and the merges
+   cost O(n log n) overall. Each class also keeps its simplest member (a
+   constant, else a symbol), which the simplifier rewrites the others to. *)
+module UF = struct
+  type cls =
+    { size : int;
+      members : ITSet.t;
+      canon : IT.t
+    }
+
+  type t =
+    { repr : IT.t ITMap.t;
+      classes : cls ITMap.t (* by representative *)
+    }
+
+  let empty = { repr = ITMap.empty; classes = ITMap.empty }
+
+  let find uf x = match ITMap.find_opt x uf.repr with Some r -> r | None -> x
+
+  let class_of uf x =
+    let r = find uf x in
+    match ITMap.find_opt r uf.classes with
+    | Some cls -> (r, cls)
+    | None -> (r, { size = 1; members = ITSet.singleton x; canon = x })
+
+
+  let rank it =
+    match IT.get_term it with IT.Const _ -> 0 | IT.Sym _ -> 1 | _ -> 2
+
+
+  let union uf x y =
+    let rx, cx = class_of uf x in
+    let ry, cy = class_of uf y in
+    if IT.equal rx ry then
+      uf
+    else (
+      let (r, big), (r', small) =
+        if cx.size >= cy.size then ((rx, cx), (ry, cy)) else ((ry, cy), (rx, cx))
+      in
+      let repr = ITSet.fold (fun z repr -> ITMap.add z r repr) small.members uf.repr in
+      let cls =
+        { size = big.size + small.size;
+          members = ITSet.union big.members small.members;
+          canon = (if rank small.canon < rank big.canon then small.canon else big.canon)
+        }
+      in
+      { repr = ITMap.add r r repr; classes = ITMap.add r cls (ITMap.remove r' uf.classes) })
+end
+
+(* An equality guarded by [g] holds in the classes for [Some g], which also
+   include all the unguarded equalities. *)
+type table =
+  { unguarded : UF.t;
+    guarded : UF.t ITMap.t
   }
 
-type table = eq_info list ITMap.t
-
-let empty = (ITMap.empty : table)
-
-(* maintaining a lookup table *)
-
-let fetch_eqs (tab : table) lhs =
-  match ITMap.find_opt lhs tab with None -> [] | Some xs -> xs
-
-
-let guard_implies guard1 guard2 =
-  match (guard1, guard2) with
-  | _, None -> true
-  | Some x, Some y -> IT.equal x y
-  | _ -> false
-
-
-let eq_is_known tab (guard, lhs, rhs) =
-  List.exists
-    (fun info -> IT.equal rhs info.rhs && guard_implies guard info.guard)
-    (fetch_eqs tab lhs)
+let empty = { unguarded = UF.empty; guarded = ITMap.empty }
 
+let add_eq_sym (guard, lhs, rhs) (tab : table) =
+  match guard with
+  | None ->
+    { unguarded = UF.union tab.unguarded lhs rhs;
+      guarded = ITMap.map (fun uf -> UF.union uf lhs rhs) tab.guarded
+    }
+  | Some g ->
+    let uf = Option.value (ITMap.find_opt g tab.guarded) ~default:tab.unguarded in
+    { tab with guarded = ITMap.add g (UF.union uf lhs rhs) tab.guarded }
 
-let add_eq (guard, lhs, rhs) (tab : table) =
-  if eq_is_known tab (guard, lhs, rhs) then
-    tab
-  else
-    ITMap.add lhs ({ guard; rhs } :: fetch_eqs tab lhs) tab
-
-
-let add_eq_sym (guard, lhs, rhs) tab =
-  add_eq (guard, lhs, rhs) (add_eq (guard, rhs, lhs) tab)
 
+let add_eq (tab : table) lhs rhs = add_eq_sym (None, lhs, rhs) tab
 
 let add_one_eq (tab : table) (it : IT.t) =
   match IT.get_term it with
@@ -61,23 +97,28 @@ let add_lc_eqs tab (lc : LogicalConstraints.t) =
   match lc with LogicalConstraints.T it -> add_eqs tab it | _ -> tab
 
 
-let fetch_implied_eqs tab guard lhs =
-  fetch_eqs tab lhs
-  |> List.filter_map (fun info ->
-    if guard_implies guard info.guard then
-      Some info.rhs
-    else
-      None)
+let classes_for (tab : table) guard =
+  match guard with
+  | None -> tab.unguarded
+  | Some g -> Option.value (ITMap.find_opt g tab.guarded) ~default:tab.unguarded
 
 
-(* computing the closure of the above *)
+(* the terms known to be equal to [x] under [guard] (including [x]) *)
 let get_eq_vals (tab : table) (guard : IT.t option) (x : IT.t) =
-  let rec seek known = function
-    | [] -> known
-    | x :: xs ->
-      if ITSet.mem x known then
-        seek known xs
-      else
-        seek (ITSet.add x known) (fetch_implied_eqs tab guard x @ xs)
-  in
-  seek ITSet.empty [ x ]
+  (snd (UF.class_of (classes_for tab guard) x)).members
+
+
+(* whether [x] and [y] are in the same class of the unguarded equalities *)
+let provably_equal (tab : table) x y =
+  IT.equal (UF.find tab.unguarded x) (UF.find tab.unguarded y)
+
+
+(* the constant or symbol that [x] is known to be equal to (unguarded), if
+   it is simpler than [x] *)
+let representative (tab : table) x =
+  if ITMap.is_empty tab.unguarded.repr then
+    None
+  else (
+    let _, cls = UF.class_of tab.unguarded x in
+    if UF.rank cls.canon < UF.rank x then Some cls.canon else None)
+
@@ -659,7 +659,10 @@ let generate_ownership_global_assignments
       List.map Ownership_exec.generate_c_local_ownership_entry_fcall globals
     in
     let global_map_stmts_ = List.map (fun e -> A.AilSexpr e) global_map_fcalls in
-    let assignments = Ownership_exec.get_ownership_global_init_stats () in
+    let assignments =
+      Cn_internal_to_ail.generate_logging_init_stats ()
+      @ Ownership_exec.get_ownership_global_init_stats ()
+    in
     let init_and_global_mapping_str =
       generate_ail_stat_strs ([], assignments @ global_map_stmts_)
     in
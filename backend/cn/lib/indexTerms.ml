@@ -466,7 +466,13 @@ let is_member = function IT (StructMember (it, id), _, _) -> Some (it, id) | _ -
 
 (* shorthands *)
 
-let use_vip = ref true
+(* whether allocation ids are modelled; a configuration flag, which domains
+   spawned after it is set inherit (see Cerb_dls) *)
+let use_vip_key = Cerb_dls.new_key ~inherit:true (fun () -> true)
+
+let use_vip () = Cerb_dls.get use_vip_key
+
+let set_use_vip b = Cerb_dls.set use_vip_key b
 
 (* lit *)
 let sym_ (sym, bt, loc) = IT (Sym sym, bt, loc)
@@ -489,7 +495,7 @@ let q_ (n, n') loc = IT (Const (Q (Q.make (Z.of_int n) (Z.of_int n'))), BT.Real,
 let q1_ q loc = IT (Const (Q q), BT.Real, loc)
 
 let pointer_ ~alloc_id ~addr loc =
-  let alloc_id = if !use_vip then alloc_id else Z.zero in
+  let alloc_id = if use_vip () then alloc_id else Z.zero in
   IT (Const (Pointer { alloc_id; addr }), BT.Loc (), loc)
 
 
@@ -961,7 +967,7 @@ let value_check_pointer mode ~pointee_ct about loc =
            (* Some (le_ (sub_ (add_ (about_int, intptr_int_ pointee_size loc) loc,
               intptr_int_ 1 loc) loc, *)
            (*         intptr_const_ Memory.max_pointer loc) loc); *)
-           (* if !use_vip then None else Some (non_vip_constraint about loc); *)
+           (* if use_vip () then None else Some (non_vip_constraint about loc); *)
            Some (aligned_ (about, pointee_ct) loc)
          ])
       loc
@@ -0,0 +1,90 @@
+module IT = IndexTerms
+module BT = BaseTypes
+
+(* permissions of iterated resources of the form [lo <= q && q < hi] (and
+   disjunctions of those), kept as lists of intervals when resources are split,
+   rather than as nested negated conjunctions *)
+
+(* lower bound (inclusive), upper bound (exclusive) *)
+type interval = IT.t * IT.t
+
+type t = interval list
+
+let rec conjuncts it =
+  match IT.is_and it with Some (x, y) -> conjuncts x @ conjuncts y | None -> [ it ]
+
+
+let is_q q it = match IT.is_sym it with Some (s, _) -> Sym.equal s q | None -> false
+
+let mentions q it = Sym.Set.mem q (IT.free_vars it)
+
+(* the lower bound of an unsigned index is dropped by the simplifier *)
+let implicit_lower bt =
+  match bt with
+  | BT.Bits (Unsigned, _) -> Some (IT.num_lit_ Z.zero bt (Locations.other __LOC__))
+  | _ -> None
+
+
+let interval_of_term (q, bt) it =
+  let lower c =
+    match IT.is_le c with
+    | Some (lo, x) when is_q q x && not (mentions q lo) -> Some lo
+    | _ -> None
+  in
+  let upper c =
+    match IT.is_lt c with
+    | Some (x, hi) when is_q q x && not (mentions q hi) -> Some hi
+    | _ -> None
+  in
+  match conjuncts it with
+  | [ c1; c2 ] ->
+    (match (lower c1, upper c2) with
+     | Some lo, Some hi -> Some (lo, hi)
+     | _ ->
+       (match (lower c2, upper c1) with Some lo, Some hi -> Some (lo, hi) | _ -> None))
+  | [ c ] ->
+    (match (implicit_lower bt, upper c) with
+     | Some lo, Some hi -> Some (lo, hi)
+     | _ -> None)
+  | _ -> None
+
+
+(* recognise a permission as a union of intervals of the quantified variable *)
+let rec of_term q it : t option =
+  if IT.is_false it then
+    Some []
+  else (
+    match IT.is_or it with
+    | Some (x, y) ->
+      (match (of_term q x, of_term q y) with
+       | Some xs, Some ys -> Some (xs @ ys)
+       | _ -> None)
+    | None -> Option.map (fun i -> [ i ]) (interval_of_term q it))
+
+
+let to_term (q, bt) (intervals : t) loc =
+  let q_it = IT.sym_ (q, bt, loc) in
+  let in_interval (lo, hi) =
+    IT.and_ [ IT.le_ (lo, q_it) loc; IT.lt_ (q_it, hi) loc ] loc
+  in
+  IT.or_ (List.map in_interval intervals) loc
+
+
+(* [diff ~le xs ys] removes the intervals [ys] from [xs]. Bounds are only
+   compared with [le], which need not be complete: where two bounds cannot be
+   ordered, the pieces are bounded by min/max terms instead. *)
+let diff ~le (xs : t) (ys : t) : t =
+  let loc = Locations.other __LOC__ in
+  let remove (a, b) (lo, hi) =
+    if le b lo || le hi a then
+      [ (lo, hi) ]
+    else (
+      let left =
+        if le a lo then [] else [ (lo, if le a hi then a else IT.min_ (hi, a) loc) ]
+      in
+      let right =
+        if le hi b then [] else [ ((if le lo b then b else IT.max_ (lo, b) loc), hi) ]
+      in
+      List.filter (fun (lo, hi) -> not (le hi lo)) (left @ right))
+  in
+  List.fold_left (fun xs y -> List.concat_map (remove y) xs) xs ys
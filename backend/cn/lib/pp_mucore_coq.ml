@@ -493,13 +493,7 @@ let pp_identifier (CF.Symbol.Identifier (loc, s)) =
   pp_constructor "Identifier" [ pp_location loc; pp_string s ]
 
 
-let pp_digest (d : Digest.t) =
-  let string_to_hex s =
-    let hex_of_char c = Printf.sprintf "%02x" (Char.code c) in
-    String.concat "" (List.map hex_of_char (String.to_seq s |> List.of_seq))
-  in
-  (* We are not using Digest.to_hex as it is gives error on invalid digest values *)
-  pp_string (string_to_hex d)
+let pp_digest (d : CF.Symbol.digest) = pp_string (Cerb_fresh.string_of_digest d)
 
 
 let rec pp_symbol_description = function
@@ -17,17 +17,17 @@ type log_entry =
 
 type log = log_entry list (* most recent first *)
 
-(* list of log entries *)
-let proof_log = ref []
+(* list of log entries, per domain as each domain verifies its own file *)
+let proof_log = Cerb_dls.new_key (fun () -> [])
 
 let add_log_entry entry =
   if !proof_log_enabled then
-    proof_log := entry :: !proof_log
+    Cerb_dls.set proof_log (entry :: Cerb_dls.get proof_log)
   else
     () (* No logging if disabled *)
 
 
-let get_proof_log () = !proof_log
+let get_proof_log () = Cerb_dls.get proof_log
 
 let record_resource_inference_step
   (c : Context.t)
@@ -29,7 +29,7 @@ let derived_lc1 ((resource : Req.t), O output) =
     let addr = IT.addr_ pointer here in
     let upper = IT.upper_bound addr ct here in
     let alloc_bounds =
-      if !IT.use_vip then
+      if IT.use_vip () then
         let module H = Alloc.History in
         let H.{ base; size } = H.(split (lookup_ptr pointer here) here) in
         [ IT.(le_ (base, addr) here); IT.(le_ (upper, add_ (base, size) here) here) ]
@@ -38,7 +38,7 @@ let derived_lc1 ((resource : Req.t), O output) =
     in
     [ IT.hasAllocId_ pointer here; IT.(le_ (addr, upper) here) ] @ alloc_bounds
   | P { name; pointer; iargs = [] }
-    when !IT.use_vip && Req.(equal_name name Predicate.alloc) ->
+    when IT.use_vip () && Req.(equal_name name Predicate.alloc) ->
     let module H = Alloc.History in
     let lookup = H.lookup_ptr pointer here in
     let H.{ base; size } = H.split lookup here in
@@ -62,10 +62,38 @@ let derived_lc2 ((resource : Req.t), _) ((resource' : Req.t), _) =
   | _ -> []
 
 
-let disable_resource_derived_constraints = ref false
+let disable_resource_derived_constraints_key = Cerb_dls.new_key ~inherit:true (fun () -> false)
 
-let pointer_facts ~new_resource ~old_resources =
-  if !disable_resource_derived_constraints then
+let set_disable_resource_derived_constraints b =
+  Cerb_dls.set disable_resource_derived_constraints_key b
+
+
+let pointer_facts ~new_resource =
+  if Cerb_dls.get disable_resource_derived_constraints_key then
     []
   else
-    derived_lc1 new_resource @ List.concat_map (derived_lc2 new_resource) old_resources
+    derived_lc1 new_resource
+
+
+(* The pairwise separation of the Owned resources is not asserted when a
+   resource is added, which would make O(n^2) disjunctions for n cells, but
+   instantiated per query: only for the pairs whose pointers both mention a
+   symbol of the query ([relevant]), or for all the pairs without
+   [relevant]. *)
+let separation_facts ?relevant resources =
+  if Cerb_dls.get disable_resource_derived_constraints_key then
+    []
+  else (
+    let mentioned = function
+      | (Req.P { name = Owned _; pointer; _ }, _) as r ->
+        (match relevant with
+         | None -> Some r
+         | Some relevant ->
+           if Sym.Set.exists relevant (IT.free_vars pointer) then Some r else None)
+      | _ -> None
+    in
+    let rec pairs = function
+      | [] -> []
+      | r :: rs -> List.concat_map (derived_lc2 r) rs @ pairs rs
+    in
+    pairs (List.filter_map mentioned resources))
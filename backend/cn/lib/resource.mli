@@ -20,6 +20,9 @@ val derived_lc1 : t -> IndexTerms.t list
 
 val derived_lc2 : t -> t -> IndexTerms.t list
 
-val disable_resource_derived_constraints : bool ref
+(** Per domain, inherited by the domains spawned after it is set *)
+val set_disable_resource_derived_constraints : bool -> unit
 
-val pointer_facts : new_resource:t -> old_resources:t list -> IndexTerms.t list
+val pointer_facts : new_resource:t -> IndexTerms.t list
+
+val separation_facts : ?relevant:(Sym.t -> bool) -> t list -> IndexTerms.t list
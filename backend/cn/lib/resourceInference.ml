@@ -159,6 +159,7 @@ module General = struct
     : (Resource.predicate * int list) option m
     =
     Pp.(debug 7 (lazy (item __LOC__ (Req.pp (P requested)))));
+    Cerb_metrics.incr "resource_inference_steps";
     let start_timing = Pp.time_log_start __LOC__ "" in
     let@ oarg_bt = WellTyped.oarg_bt_of_pred loc requested.name in
     let@ provable = provable loc in
@@ -248,6 +249,7 @@ module General = struct
 
   and qpredicate_request_aux loc uiinfo (requested : Req.QPredicate.t) =
     Pp.(debug 7 (lazy (item __LOC__ (Req.pp (Q requested)))));
+    Cerb_metrics.incr "resource_inference_steps";
     let@ provable = provable loc in
     let@ simp_ctxt = simp_ctxt () in
     let needed = requested.permission in
@@ -300,17 +302,40 @@ module General = struct
                   | `True ->
                     Pp.debug 9 (lazy (Pp.item "used resource" (Req.pp (fst re))));
                     let open IT in
-                    let needed' =
-                      [ needed; not_ (and_ [ iarg_match; p'.permission ] here) here ]
+                    let intervals =
+                      let of_term = PermissionIntervals.of_term requested.q in
+                      match (requested.iargs, of_term needed, of_term p'.permission) with
+                      | [], Some needed_is, Some have_is -> Some (needed_is, have_is)
+                      | _ -> None
                     in
-                    let permission' =
-                      [ p'.permission; not_ (and_ [ iarg_match; needed ] here) here ]
+                    let needed', permission' =
+                      match intervals with
+                      | Some (needed_is, have_is) ->
+                        (* split the intervals structurally, only asking the
+                           solver to order their bounds *)
+                        let le x y =
+                          match provable (LC.T (le_ (x, y) here)) with
+                          | `True -> true
+                          | `False -> false
+                        in
+                        let diff = PermissionIntervals.diff ~le in
+                        let to_term is =
+                          PermissionIntervals.to_term requested.q is here
+                        in
+                        ( to_term (diff needed_is have_is),
+                          to_term (diff have_is needed_is) )
+                      | None ->
+                        let minus x y =
+                          and_ [ x; not_ (and_ [ iarg_match; y ] here) here ] here
+                        in
+                        ( Simplify.IndexTerms.simp simp_ctxt (minus needed p'.permission),
+                          minus p'.permission needed )
                     in
                     let oarg =
                       add_case (Many { many_guard = took; value = p'_oarg }) oarg
                     in
-                    ( Changed (Q { p' with permission = and_ permission' here }, O p'_oarg),
-                      (Simplify.IndexTerms.simp simp_ctxt (and_ needed' here), oarg) )
+                    ( Changed (Q { p' with permission = permission' }, O p'_oarg),
+                      (needed', oarg) )
                   | `False ->
                     let model = Solver.model () in
                     Pp.debug
@@ -247,6 +247,12 @@ let bv_sign_extend i x = app (ifam "sign_extend" [ i ]) [ x ]
 (** Zero extend by the given number of bits. *)
 let bv_zero_extend i x = app (ifam "zero_extend" [ i ]) [ x ]
 
+(** The unsigned value of a bit-vector, as an integer. *)
+let bv_to_nat x = app_ "bv2nat" [ x ]
+
+(** The bit-vector of width [w] for an integer, modulo [2^w]. *)
+let bv_of_int w x = app (ifam "int2bv" [ w ]) [ x ]
+
 (** [bv_extract i j x] is a sub-vector of [x].
     [i] is the larger bit index, [j] is the smaller one, and indexing
     is inclusive. *)
@@ -69,6 +69,8 @@ type solver_frame =
     (** Uninterpreted functions and variables that we've declared. *)
     mutable bt_uninterpreted : SMT.sexp Int_BT_Table.t;
     (** Uninterpreted constants, indexed by base type. *)
+    mutable defined : SMT.sexp Sym.Map.t;
+    (** Non-recursive logical functions that we've defined. *)
     mutable ctypes : int CTypeMap.t
     (** Declarations for C types. Each C type is assigned a unique integer. *)
   }
@@ -77,6 +79,7 @@ let empty_solver_frame () =
   { commands = [];
     uninterpreted = Sym.Map.empty;
     bt_uninterpreted = Int_BT_Table.empty;
+    defined = Sym.Map.empty;
     ctypes = CTypeMap.empty
   }
 
@@ -106,6 +109,8 @@ module Debug = struct
     |> Sym.Map.fold dump_sym f.uninterpreted
     |> append "# Basetypes "
     |> Int_BT_Table.fold dump_bts f.bt_uninterpreted
+    |> append "# Definitions "
+    |> Sym.Map.fold dump_sym f.defined
     |> append "+---------------------------------"
 
 
@@ -272,13 +277,13 @@ end
 
 module CN_AllocId = struct
   (** The type to use  for allocation ids *)
-  let t () = if !use_vip then SMT.t_int else CN_Tuple.t []
+  let t () = if use_vip () then SMT.t_int else CN_Tuple.t []
 
   (** Parse an allocation id from an S-expression *)
-  let from_sexp s = if !use_vip then SMT.to_z s else Z.zero
+  let from_sexp s = if use_vip () then SMT.to_z s else Z.zero
 
   (** Convert an allocation id to an S-expression *)
-  let to_sexp s = if !use_vip then SMT.int_zk s else CN_Tuple.con []
+  let to_sexp s = if use_vip () then SMT.int_zk s else CN_Tuple.con []
 end
 
 module CN_MemByte = struct
@@ -473,6 +478,100 @@ module CN_List = struct
     SMT.ite (SMT.is_con cons_name xs) (SMT.app_ tail_name [ xs ]) orelse
 end
 
+(** Represent [Bits] values as (mathematical) integers in the range of their
+    type, rather than as bit-vectors. Arithmetic wraps around with explicit
+    [mod]s, except where [bits_range] shows it cannot overflow, and the bitwise
+    operations go through bit-vectors. [Check.int_encoding_functions] selects
+    it for some functions only. The solvers are often much faster on the
+    resulting (linear or nonlinear) integer problems. Ranges are assumed for
+    declared variables (including their struct and record fields), and
+    enforced where a [Bits] value is read out of a map, a list, a datatype or
+    an uninterpreted function. The values held inside such aggregates are not
+    constrained, so equalities between aggregates can be unprovable here even
+    when they hold in the bit-vector encoding. *)
+let int_encoding = ref false
+
+(** [Bits] values represented as integers, see [int_encoding] *)
+module CN_Int = struct
+  let is_signed sign = BT.(equal_sign sign Signed)
+
+  let modulus w = Z.shift_left Z.one w
+
+  let min_value (sign, w) = if is_signed sign then Z.neg (modulus (w - 1)) else Z.zero
+
+  let max_value (sign, w) =
+    Z.pred (if is_signed sign then modulus (w - 1) else modulus w)
+
+
+  let in_range bits x =
+    SMT.bool_and
+      (SMT.num_leq (SMT.int_zk (min_value bits)) x)
+      (SMT.num_leq x (SMT.int_zk (max_value bits)))
+
+
+  (** Two's complement wrap-around into the range of the type *)
+  let wrap (sign, w) x =
+    let m = SMT.int_zk (modulus w) in
+    if is_signed sign then (
+      let half = SMT.int_zk (modulus (w - 1)) in
+      SMT.num_sub (SMT.num_mod (SMT.num_add x half) m) half)
+    else
+      SMT.num_mod x m
+
+
+  let normalise (sign, w) z =
+    let u = Z.erem z (modulus w) in
+    if is_signed sign && Z.geq u (modulus (w - 1)) then Z.sub u (modulus w) else u
+
+
+  let of_bv bits x = wrap bits (SMT.bv_to_nat x)
+
+  let to_bv w x = SMT.bv_of_int w x
+
+  let zero = SMT.int_k 0
+
+  let is_neg x = SMT.num_lt x zero
+
+  let abs x = SMT.ite (is_neg x) (SMT.num_neg x) x
+
+  (* The following duplicate their arguments. Division by zero is as for
+     SMT-LIB's bit-vectors. *)
+
+  (** C division, which truncates towards zero *)
+  let div (sign, w) x y =
+    if is_signed sign then (
+      let q = SMT.num_div (abs x) (abs y) in
+      let q = SMT.ite (SMT.eq (is_neg x) (is_neg y)) q (SMT.num_neg q) in
+      let by_zero = SMT.ite (is_neg x) (SMT.int_k 1) (SMT.int_k (-1)) in
+      SMT.ite (SMT.eq y zero) by_zero (wrap (sign, w) q))
+    else
+      SMT.ite (SMT.eq y zero) (SMT.int_zk (max_value (sign, w))) (SMT.num_div x y)
+
+
+  (** C remainder, which has the sign of the dividend *)
+  let rem (sign, _) x y =
+    if is_signed sign then (
+      let r = SMT.num_mod (abs x) (abs y) in
+      SMT.ite (SMT.eq y zero) x (SMT.ite (is_neg x) (SMT.num_neg r) r))
+    else
+      SMT.ite (SMT.eq y zero) x (SMT.num_mod x y)
+
+
+  (** [bvsmod]: the remainder has the sign of the divisor *)
+  let modulo (sign, w) x y =
+    if is_signed sign then (
+      let r = SMT.num_mod (abs x) (abs y) in
+      let signed_r =
+        SMT.ite
+          (SMT.eq (is_neg x) (is_neg y))
+          (SMT.ite (is_neg x) (SMT.num_neg r) r)
+          (SMT.ite (is_neg x) (SMT.num_add (SMT.num_neg r) y) (SMT.num_add r y))
+      in
+      SMT.ite (SMT.eq y zero) x (SMT.ite (SMT.eq r zero) zero signed_r))
+    else
+      rem (sign, w) x y
+end
+
 (** {1 Type to SMT} *)
 
 (** Translate a base type to SMT *)
@@ -481,6 +580,7 @@ let rec translate_base_type = function
   | Bool -> SMT.t_bool
   | Integer -> SMT.t_int
   | MemByte -> CN_MemByte.t
+  | Bits _ when !int_encoding -> SMT.t_int
   | Bits (_, n) -> SMT.t_bits n
   | Real -> SMT.t_real
   | Loc () -> CN_Pointer.t
@@ -509,6 +609,8 @@ and get_value gs ctys bt (sexp : SMT.sexp) =
   | BT.Unit -> Const Unit
   | Bool -> Const (Bool (SMT.to_bool sexp))
   | Integer -> Const (Z (SMT.to_z sexp))
+  | Bits (sign, n) when !int_encoding ->
+    Const (Bits ((sign, n), CN_Int.normalise (sign, n) (SMT.to_z sexp)))
   | Bits (sign, n) ->
     let signed = BT.(equal_sign sign Signed) in
     Const (Bits ((sign, n), SMT.to_bits n signed sexp))
@@ -517,11 +619,7 @@ and get_value gs ctys bt (sexp : SMT.sexp) =
     (match SMT.to_con sexp with
      | con, [ salloc_id; svalue ] when String.equal con CN_MemByte.alloc_id_value_name ->
        let alloc_id = CN_AllocId.from_sexp salloc_id in
-       let value =
-         match get_value gs ctys (BT.Bits (Unsigned, CN_MemByte.width)) svalue with
-         | Const (Bits (_, z)) -> z
-         | _ -> failwith "Memory byte value is not bits"
-       in
+       let value = SMT.to_bits CN_MemByte.width false svalue in
        Const (MemByte { alloc_id; value })
      | _ -> failwith "MemByte")
   | Loc () ->
@@ -529,11 +627,7 @@ and get_value gs ctys bt (sexp : SMT.sexp) =
      | con, [] when String.equal con CN_Pointer.null_name -> Const Null
      | con, [ sbase; saddr ] when String.equal con CN_Pointer.alloc_id_addr_name ->
        let base = CN_AllocId.from_sexp sbase in
-       let addr =
-         match get_value gs ctys Memory.uintptr_bt saddr with
-         | Const (Bits (_, z)) -> z
-         | _ -> failwith "Pointer value is not bits"
-       in
+       let addr = SMT.to_bits CN_Pointer.width false saddr in
        Const (Pointer { alloc_id = base; addr })
      | _ -> failwith "Loc")
   | Alloc_id -> Const (Alloc_id (CN_AllocId.from_sexp sexp))
@@ -595,6 +689,7 @@ and get_value gs ctys bt (sexp : SMT.sexp) =
 let translate_const s co =
   match co with
   | Z z -> SMT.int_zk z
+  | Bits (_, z) when !int_encoding -> SMT.int_zk z
   | Bits ((_, w), z) -> SMT.bv_k w z
   | Q q -> SMT.real_k q
   | MemByte b ->
@@ -674,6 +769,32 @@ let bv_ctz result_w =
   count
 
 
+(** With [int_encoding], the ranges of the [Bits] values in a value of type
+    [bt], including those in its struct, record and tuple fields. The values
+    in maps, lists and datatypes are guarded where they are read instead (see
+    [translate_term]), as constraining them here would need quantifiers. *)
+let rec int_range_facts s bt e =
+  match bt with
+  | BT.Bits bits -> [ CN_Int.in_range bits e ]
+  | Struct tag ->
+    let layout = Sym.Map.find tag s.globals.struct_decls in
+    List.concat_map
+      (fun (member, sct) ->
+        int_range_facts
+          s
+          (Memory.bt_of_sct sct)
+          (SMT.app_ (CN_Names.struct_field_name member) [ e ]))
+      (Memory.member_types layout)
+  | Record members ->
+    let arity = List.length members in
+    List.concat
+      (List.mapi (fun n (_, bt) -> int_range_facts s bt (CN_Tuple.get arity n e)) members)
+  | Tuple bts ->
+    let arity = List.length bts in
+    List.concat (List.mapi (fun n bt -> int_range_facts s bt (CN_Tuple.get arity n e)) bts)
+  | _ -> []
+
+
 (** Translate a variable to SMT.  Declare if needed. *)
 let translate_var s name bt =
   let check f = Sym.Map.find_opt name f.uninterpreted in
@@ -683,11 +804,67 @@ let translate_var s name bt =
     let sname = CN_Names.var_name name in
     ack_command s (SMT.declare sname (translate_base_type bt));
     let e = SMT.atom sname in
+    if !int_encoding then
+      List.iter (fun fact -> ack_command s (SMT.assume fact)) (int_range_facts s bt e);
     let f = !(s.cur_frame) in
     f.uninterpreted <- Sym.Map.add name e f.uninterpreted;
     e
 
 
+(** Pointer offsets and addresses are bit-vectors, also with [int_encoding] *)
+let uintptr_bv x = if !int_encoding then CN_Int.to_bv CN_Pointer.width x else x
+
+(** The casts that [int_encoding] translates differently *)
+let cast_via_int = function
+  | BT.Bits _, BT.Loc () | Loc (), Bits _ | MemByte, Bits _ | Bits _, Bits _ -> true
+  | _ -> false
+
+
+(** A bound on the values of a [Bits] term of type [bits], for [int_encoding]:
+    the range of the constants, and of the arithmetic and casts on them when
+    this does not wrap around, and the range of the type otherwise. The
+    operations whose (unwrapped) result is within the range of their type are
+    translated without a [mod]. *)
+let rec bits_range bits it =
+  let lo, hi = (CN_Int.min_value bits, CN_Int.max_value bits) in
+  match unwrapped_range bits it with
+  | Some (l, h) when Z.leq lo l && Z.leq h hi -> (l, h)
+  | _ -> (lo, hi)
+
+
+(** The range of the result of [it] before wrapping into its type, if known *)
+and unwrapped_range bits it =
+  match IT.get_term it with
+  | Const (Bits (_, z)) -> Some (z, z)
+  | Binop (((Add | Sub | Mul) as op), e1, e2) ->
+    let l1, h1 = bits_range bits e1 in
+    let l2, h2 = bits_range bits e2 in
+    (match op with
+     | Add -> Some (Z.add l1 l2, Z.add h1 h2)
+     | Sub -> Some (Z.sub l1 h2, Z.sub h1 l2)
+     | _ ->
+       let ps = [ Z.mul l1 l2; Z.mul l1 h2; Z.mul h1 l2; Z.mul h1 h2 ] in
+       Some (List.fold_left Z.min (List.hd ps) ps, List.fold_left Z.max (List.hd ps) ps))
+  | Unop (Negate, e1) ->
+    let l1, h1 = bits_range bits e1 in
+    Some (Z.neg h1, Z.neg l1)
+  | Cast (_, e1) ->
+    Option.map (fun bits' -> bits_range bits' e1) (BT.is_bits_bt (IT.get_bt e1))
+  | _ -> None
+
+
+(** Whether the [Bits] term [it] of type [bits] is computed without wrapping
+    around, see [bits_range] *)
+let does_not_wrap bits it =
+  match unwrapped_range bits it with
+  | Some (l, h) -> Z.leq (CN_Int.min_value bits) l && Z.leq h (CN_Int.max_value bits)
+  | None -> false
+
+
+(** Translate the body of logical functions at each call, rather than defining
+    them once with [define-fun]. *)
+let inline_definitions = ref false
+
 (** Translate a CN term to SMT *)
 let rec translate_term s iterm =
   let loc = IT.get_loc iterm in
@@ -703,9 +880,64 @@ let rec translate_term s iterm =
     let here = Locations.other __LOC__ in
     translate_term s (IT.default_ bt here)
   in
+  (* the [Bits] operations that are translated differently by [int_encoding] *)
+  let int_bits e =
+    if !int_encoding then BT.is_bits_bt (IT.get_bt e) else None
+  in
+  (* With [int_encoding], a [Bits] value read out of a map, a list or a
+     datatype, or returned by an uninterpreted function, is an unconstrained
+     integer: map it into the range of its type (this is the identity on the
+     values in range). *)
+  (* wrap [x], the translation of [iterm], into the range [bits], unless
+     [bits_range] shows that it is in range already *)
+  let wrap_unless_in_range bits x =
+    if does_not_wrap bits iterm then x else CN_Int.wrap bits x
+  in
+  let int_range_guard bt e =
+    match BT.is_bits_bt bt with
+    | Some bits when !int_encoding ->
+      maybe_name e (fun x ->
+        SMT.ite (CN_Int.in_range bits x) x (SMT.int_zk (CN_Int.min_value bits)))
+    | _ -> e
+  in
   match IT.get_term iterm with
   | Const c -> translate_const s c
   | Sym x -> translate_var s x (IT.get_bt iterm)
+  | Unop (((Negate | BW_Compl | BW_CLZ_NoSMT | BW_CTZ_NoSMT) as op), e1)
+    when Option.is_some (int_bits e1) ->
+    let ((_, w) as bits) = Option.get (int_bits e1) in
+    let s1 = translate_term s e1 in
+    (match op with
+     | Negate -> wrap_unless_in_range bits (SMT.num_neg s1)
+     | BW_Compl -> CN_Int.wrap bits (SMT.num_sub (SMT.num_neg s1) (SMT.int_k 1))
+     | BW_CLZ_NoSMT -> CN_Int.of_bv bits (maybe_name (CN_Int.to_bv w s1) (bv_clz w w))
+     | _ -> CN_Int.of_bv bits (maybe_name (CN_Int.to_bv w s1) (bv_ctz w w)))
+  | Binop
+      ( (( Add | Sub | Mul | Div | Rem | Mod | BW_Xor | BW_And | BW_Or | ShiftLeft
+         | ShiftRight | LT | LE ) as op),
+        e1,
+        e2 )
+    when Option.is_some (int_bits e1) ->
+    let ((sign, w) as bits) = Option.get (int_bits e1) in
+    let s1 = translate_term s e1 in
+    let s2 = translate_term s e2 in
+    let via_bv f = CN_Int.of_bv bits (f (CN_Int.to_bv w s1) (CN_Int.to_bv w s2)) in
+    let by_cases f = maybe_name s1 (fun s1 -> maybe_name s2 (fun s2 -> f bits s1 s2)) in
+    (match op with
+     | Add -> wrap_unless_in_range bits (SMT.num_add s1 s2)
+     | Sub -> wrap_unless_in_range bits (SMT.num_sub s1 s2)
+     | Mul -> wrap_unless_in_range bits (SMT.num_mul s1 s2)
+     | Div -> by_cases CN_Int.div
+     | Rem -> by_cases CN_Int.rem
+     | Mod -> by_cases CN_Int.modulo
+     | BW_Xor -> via_bv SMT.bv_xor
+     | BW_And -> via_bv SMT.bv_and
+     | BW_Or -> via_bv SMT.bv_or
+     | ShiftLeft -> via_bv SMT.bv_shl
+     | ShiftRight when CN_Int.is_signed sign -> via_bv SMT.bv_ashr
+     | ShiftRight -> via_bv SMT.bv_lshr
+     | LT -> SMT.num_lt s1 s2
+     | _ -> SMT.num_leq s1 s2)
   | Unop (op, e1) ->
     (match op with
      | BW_FFS_NoSMT ->
@@ -938,7 +1170,9 @@ let rec translate_term s iterm =
     CN_Pointer.ptr_shift
       ~ptr:(translate_term s t)
       ~null_case:(default (Loc ()))
-      ~offset:(translate_term s (IT (OffsetOf (tag, member), Memory.uintptr_bt, loc)))
+      ~offset:
+        (let offset = IT (OffsetOf (tag, member), Memory.uintptr_bt, loc) in
+         uintptr_bv (translate_term s offset))
   | ArrayShift { base; ct; index } ->
     CN_Pointer.ptr_shift
       ~ptr:(translate_term s base)
@@ -952,19 +1186,21 @@ let rec translate_term s iterm =
            else
              cast_ Memory.uintptr_bt index loc
          in
-         translate_term s (mul_ (el_size, ix) loc))
+         uintptr_bv (translate_term s (mul_ (el_size, ix) loc)))
   | CopyAllocId { addr; loc } ->
     CN_Pointer.copy_alloc_id
       ~ptr:(translate_term s loc)
       ~null_case:(default (Loc ()))
-      ~addr:(translate_term s addr)
+      ~addr:(uintptr_bv (translate_term s addr))
   | HasAllocId loc -> SMT.is_con CN_Pointer.alloc_id_addr_name (translate_term s loc)
   (* Lists *)
   | Nil bt -> CN_List.nil (translate_base_type bt)
   | Cons (e1, e2) -> CN_List.cons (translate_term s e1) (translate_term s e2)
   | Head e1 ->
-    maybe_name (translate_term s e1) (fun xs ->
-      CN_List.head xs (translate_term s (default_ (IT.get_bt iterm) loc)))
+    int_range_guard
+      (IT.get_bt iterm)
+      (maybe_name (translate_term s e1) (fun xs ->
+         CN_List.head xs (translate_term s (default_ (IT.get_bt iterm) loc))))
   | Tail e1 ->
     maybe_name (translate_term s e1) (fun xs ->
       CN_List.tail xs (translate_term s (default_ (IT.get_bt iterm) loc)))
@@ -974,7 +1210,7 @@ let rec translate_term s iterm =
     let bt = IT.get_bt iterm in
     let res_t = translate_base_type bt in
     let f = declare_bt_uninterpreted s CN_Constant.nth_list bt arg_ts res_t in
-    SMT.app f args
+    int_range_guard bt (SMT.app f args)
   | ArrayToList (x, y, z) ->
     let arg x = (translate_base_type (IT.get_bt x), translate_term s x) in
     let arg_ts, args = List.split (List.map arg [ x; y; z ]) in
@@ -1005,18 +1241,25 @@ let rec translate_term s iterm =
        SMT.arr_const kt vt (translate_term s e1))
   | MapSet (mp, k, v) ->
     SMT.arr_store (translate_term s mp) (translate_term s k) (translate_term s v)
-  | MapGet (mp, k) -> SMT.arr_select (translate_term s mp) (translate_term s k)
+  | MapGet (mp, k) ->
+    int_range_guard
+      (IT.get_bt iterm)
+      (SMT.arr_select (translate_term s mp) (translate_term s k))
   | MapDef _ -> failwith "MapDef"
   | Apply (name, args) ->
     let def = Option.get (get_logical_function_def s.globals name) in
     (match def.body with
-     | Def body -> translate_term s (Definition.Function.open_ def.args body args)
+     | Def body when !inline_definitions ->
+       translate_term s (Definition.Function.open_ def.args body args)
+     | Def body ->
+       let fu = define_function s name def.args def.return_bt body in
+       SMT.app fu (List.map (translate_term s) args)
      | _ ->
        let do_arg arg = translate_base_type (IT.get_bt arg) in
        let args_ts = List.map do_arg args in
        let res_t = translate_base_type def.return_bt in
        let fu = declare_uninterpreted s name args_ts res_t in
-       SMT.app fu (List.map (translate_term s) args))
+       int_range_guard def.return_bt (SMT.app fu (List.map (translate_term s) args)))
   | Let ((x, e1), e2) ->
     let se1 = translate_term s e1 in
     let name = CN_Names.var_name x in
@@ -1031,9 +1274,9 @@ let rec translate_term s iterm =
     (* CN supports nested patterns, while SMTLIB does not, so we compile patterns to a
        optional predicate, and defined variables. *)
   | Match (e1, alts) ->
-    let rec match_pat v (Pat (pat, _, _)) =
+    let rec match_pat v (Pat (pat, bt, _)) =
       match pat with
-      | PSym x -> (None, [ (CN_Names.var_name x, v) ])
+      | PSym x -> (None, [ (CN_Names.var_name x, int_range_guard bt v) ])
       | PWild -> (None, [])
       | PConstructor (c, fs) ->
         let field (f, nested) =
@@ -1057,11 +1300,27 @@ let rec translate_term s iterm =
     let x = fresh_name s "match" in
     SMT.let_ [ (x, translate_term s e1) ] (do_alts (SMT.atom x) alts)
   (* Casts *)
+  | WrapI (ity, arg) when !int_encoding ->
+    let bits = Option.get (BT.is_bits_bt (Memory.bt_of_sct (Sctypes.Integer ity))) in
+    CN_Int.wrap bits (translate_term s arg)
   | WrapI (ity, arg) ->
     bv_cast
       ~to_:(Memory.bt_of_sct (Sctypes.Integer ity))
       ~from:(IT.get_bt arg)
       (translate_term s arg)
+  | Cast (cbt, t) when !int_encoding && cast_via_int (IT.get_bt t, cbt) ->
+    let smt_term = translate_term s t in
+    (match (IT.get_bt t, cbt) with
+     | Bits _, Loc () ->
+       CN_Pointer.bits_to_ptr
+         ~bits:(CN_Int.to_bv CN_Pointer.width smt_term)
+         ~alloc_id:(default Alloc_id)
+     | Loc (), Bits (sign, w) ->
+       CN_Int.wrap (sign, w) (SMT.bv_to_nat (CN_Pointer.addr_of ~ptr:smt_term))
+     | MemByte, Bits (sign, w) ->
+       CN_Int.wrap (sign, w) (SMT.bv_to_nat (SMT.app_ CN_MemByte.value_name [ smt_term ]))
+     | _, Bits (sign, w) -> wrap_unless_in_range (sign, w) smt_term
+     | _ -> assert false)
   | Cast (cbt, t) ->
     let smt_term = translate_term s t in
     (match (IT.get_bt t, cbt) with
@@ -1098,6 +1357,38 @@ let rec translate_term s iterm =
      | _ -> assert false)
 
 
+(** Define a non-recursive logical function, once per scope. The body is
+    translated with the parameters bound to the [define-fun]'s parameter names;
+    anything else it needs (e.g. other definitions) is declared before it. *)
+and define_function s name params return_bt body =
+  let check f = Sym.Map.find_opt name f.defined in
+  match search_frames s check with
+  | Some e -> e
+  | None ->
+    let f = !(s.cur_frame) in
+    let saved = f.uninterpreted in
+    let bind_param (x, bt) =
+      let x_name = CN_Names.var_name x in
+      f.uninterpreted <- Sym.Map.add x (SMT.atom x_name) f.uninterpreted;
+      (x_name, translate_base_type bt)
+    in
+    let smt_params = List.map bind_param params in
+    let smt_body = translate_term s body in
+    (* drop the parameters, keeping whatever the body declared *)
+    let restore (x, _) =
+      match Sym.Map.find_opt x saved with
+      | Some e -> f.uninterpreted <- Sym.Map.add x e f.uninterpreted
+      | None -> f.uninterpreted <- Sym.Map.remove x f.uninterpreted
+    in
+    List.iter restore params;
+    let sname = CN_Names.uninterpreted_name name in
+    let smt_return = translate_base_type return_bt in
+    ack_command s (SMT.define_fun sname smt_params smt_return smt_body);
+    let e = SMT.atom sname in
+    f.defined <- Sym.Map.add name e f.defined;
+    e
+
+
 (** Add an assertion.  Quantified predicates are ignored. *)
 let add_assumption solver global lc =
   let s1 = { solver with globals = global } in
@@ -1132,7 +1423,7 @@ let translate_goal solver assumptions lc =
         translate_term solver new_asmp :: acc
       | _ -> acc
     in
-    LC.Set.fold check_asmp assumptions acc0
+    List.fold_right check_asmp assumptions acc0
   in
   { instantiated with extra = List.fold_left add_asmps [] instantiated.qs }
 
@@ -1254,6 +1545,35 @@ let solver_type = ref (None : SMT.solver_extensions option)
 
 let solver_flags = ref (None : string list option)
 
+(** Per-query limits: a time limit in milliseconds, and a solver-specific
+    resource limit. [None] leaves the solver's default (no limit). *)
+let query_timeout = ref (None : int option)
+
+let query_rlimit = ref (None : int option)
+
+(** Retry a query that came back "unknown" once, with a larger time budget
+    (Z3 only: CVC5 only takes its limits on the command line). *)
+let retry_unknown = ref false
+
+(** A query the solver could not decide within its limits. *)
+exception Unknown_result of Locations.t * LC.t
+
+let with_query_limits (cfg : SMT.solver_config) =
+  let limits =
+    List.filter_map
+      (fun (name, limit) -> Option.map (fun n -> (name, string_of_int n)) limit)
+      [ ("timeout", !query_timeout); ("rlimit", !query_rlimit) ]
+  in
+  match cfg.exts with
+  | SMT.Z3 -> { cfg with params = cfg.params @ limits }
+  | SMT.CVC5 ->
+    let flag (name, n) =
+      let name = if String.equal name "timeout" then "tlimit" else name in
+      "--" ^ name ^ "-per=" ^ n
+    in
+    { cfg with opts = cfg.opts @ List.map flag limits }
+  | SMT.Other -> cfg
+
 (** Make a new solver instance *)
 let make globals =
   let cfg =
@@ -1275,6 +1595,7 @@ let make globals =
   in
   (match !solver_path with Some path -> cfg := { !cfg with SMT.exe = path } | None -> ());
   (match !solver_flags with Some opts -> cfg := { !cfg with SMT.opts } | None -> ());
+  cfg := with_query_limits !cfg;
   cfg
   := { !cfg with
        log =
@@ -1296,6 +1617,16 @@ let make globals =
   s
 
 
+(** [SMT.check], accounting the time spent waiting for the solver. *)
+let check_timed smt_solver =
+  if !Cerb_metrics.enabled then (
+    let d, res = Pp.time_f_elapsed SMT.check smt_solver in
+    Cerb_metrics.add_time "solver" d;
+    res)
+  else
+    SMT.check smt_solver
+
+
 (* ---------------------------------------------------------------------------*)
 (* GLOBAL STATE: Models *)
 (* ---------------------------------------------------------------------------*)
@@ -1308,37 +1639,54 @@ type model_with_q = model * (Sym.t * BaseTypes.t) list
 
 type model_table = (model, model_fn) Hashtbl.t
 
-let models_tbl : model_table = Hashtbl.create 1
-
-let empty_model =
-  let model = Option.some in
-  Hashtbl.add models_tbl 0 model;
-  0
-
+let empty_model = 0
 
 type model_state =
   | Model of model_with_q
   | No_model
 
-let model_state = ref No_model
+(** The models are per domain (see Cerb_dls): the table of the models found so
+    far, the outcome of the last query, and the internal state of the model
+    evaluator, which reuses its solver across consecutive calls for efficiency *)
+type models =
+  { tbl : model_table;
+    mutable last : model_state;
+    mutable evaluator_solver : Simple_smt.solver option;
+    mutable currently_loaded : model;
+    mutable last_id : model
+  }
+
+let models_key =
+  Cerb_dls.new_key (fun () ->
+    let tbl = Hashtbl.create 1 in
+    Hashtbl.add tbl empty_model Option.some;
+    { tbl;
+      last = No_model;
+      evaluator_solver = None;
+      currently_loaded = 0;
+      last_id = empty_model
+    })
 
-let model () = match !model_state with No_model -> assert false | Model mo -> mo
+
+let models () = Cerb_dls.get models_key
+
+let set_model_state st = (models ()).last <- st
+
+let model () = match (models ()).last with No_model -> assert false | Model mo -> mo
 
 (** Evaluate terms in the context of a model computed by the solver. *)
 let model_evaluator, reset_model_evaluator_state =
-  (* internal state for the model evaluator, reuses the solver across consecutive calls for efficiency *)
-  let model_evaluator_solver : Simple_smt.solver option ref = ref None in
-  let currently_loaded_model = ref 0 in
-  let model_id = ref 0 in
   let new_model_id () =
     (* Start with 1, as 0 is the id of the empty model *)
-    model_id := !model_id + 1;
-    !model_id
+    let ms = models () in
+    ms.last_id <- ms.last_id + 1;
+    ms.last_id
   in
   let reset_model_evaluator_state () =
-    currently_loaded_model := 0;
-    model_evaluator_solver := None;
-    model_id := 0
+    let ms = models () in
+    ms.currently_loaded <- 0;
+    ms.evaluator_solver <- None;
+    ms.last_id <- 0
   in
   let model_evaluator solver mo =
     match SMT.to_list mo with
@@ -1347,11 +1695,11 @@ let model_evaluator, reset_model_evaluator_state =
       let scfg = solver.smt_solver.config in
       let cfg = { scfg with log = Logger.make "model" } in
       let smt_solver, new_solver =
-        match !model_evaluator_solver with
+        match (models ()).evaluator_solver with
         | Some smt_solver -> (smt_solver, false)
         | None ->
           let s = SMT.new_solver cfg in
-          model_evaluator_solver := Some s;
+          (models ()).evaluator_solver <- Some s;
           (s, true)
       in
       let model_id = new_model_id () in
@@ -1361,10 +1709,13 @@ let model_evaluator, reset_model_evaluator_state =
           cur_frame = ref (empty_solver_frame ());
           prev_frames =
             ref
-              (List.map copy_solver_frame (!(solver.cur_frame) :: !(solver.prev_frames)))
+              (List.map
+                 (fun f -> { (copy_solver_frame f) with defined = Sym.Map.empty })
+                 (!(solver.cur_frame) :: !(solver.prev_frames)))
             (* We keep the prev_frames because things that were declared, would now be
                defined by the model. Also, we need the infromation about the C type
-               mapping. *);
+               mapping. The logical function definitions are not part of the model, so
+               they are defined again in the evaluator, as needed. *);
           name_seed = solver.name_seed;
           globals = gs
         }
@@ -1373,20 +1724,22 @@ let model_evaluator, reset_model_evaluator_state =
         declare_solver_basics evaluator;
         push evaluator);
       let model_fn e =
-        if not (!currently_loaded_model = model_id) then (
-          currently_loaded_model := model_id;
+        let ms = models () in
+        if not (ms.currently_loaded = model_id) then (
+          ms.currently_loaded <- model_id;
           pop evaluator 1;
           push evaluator;
           List.iter (debug_ack_command evaluator) defs);
         let inp = translate_term evaluator e in
-        match SMT.check smt_solver with
+        Cerb_metrics.incr "smt_model_queries";
+        match check_timed smt_solver with
         | SMT.Sat ->
           let res = SMT.get_expr smt_solver inp in
           let ctys = get_ctype_table evaluator in
           Some (get_ivalue gs ctys (get_bt e) (SMT.no_let res))
         | _ -> None
       in
-      Hashtbl.add models_tbl model_id model_fn;
+      Hashtbl.add (models ()).tbl model_id model_fn;
       model_id
   in
   (model_evaluator, reset_model_evaluator_state)
@@ -1395,28 +1748,42 @@ let model_evaluator, reset_model_evaluator_state =
 (* ---------------------------------------------------------------------------*)
 
 (** The main way to query the solver. *)
-let provable ~loc ~solver ~global ~assumptions ~simp_ctxt lc =
-  let _ = loc in
-  (* ISD: should we use this somehow? *)
+let provable ~loc ~solver ~global ~assumptions ?(hypotheses = lazy []) ~simp_ctxt lc =
   let s1 = { solver with globals = global } in
   let rtrue () =
-    model_state := No_model;
+    set_model_state No_model;
     `True
   in
   match shortcut simp_ctxt lc with
-  | `True -> rtrue ()
+  | `True ->
+    Cerb_metrics.incr "smt_queries_shortcut";
+    rtrue ()
   | `No_shortcut lc ->
     let { expr; qs; extra } = translate_goal s1 assumptions lc in
+    let extra = List.map (translate_term s1) (Lazy.force hypotheses) @ extra in
     let model_from sol =
       let defs = SMT.get_model sol in
       let mo = model_evaluator s1 defs in
-      model_state := Model (mo, qs)
+      set_model_state (Model (mo, qs))
     in
     let nlc = SMT.bool_not expr in
     let inc = s1.smt_solver in
     debug_ack_command s1 (SMT.push 1);
     debug_ack_command s1 (SMT.assume (SMT.bool_ands (nlc :: extra)));
-    let res = SMT.check inc in
+    Cerb_metrics.incr "smt_queries";
+    let res =
+      match (check_timed inc, !query_timeout, inc.SMT.config.exts) with
+      | SMT.Unknown, Some ms, SMT.Z3 when !retry_unknown ->
+        Cerb_metrics.incr "smt_queries_retried";
+        let set_timeout ms =
+          debug_ack_command s1 (SMT.set_option ":timeout" (string_of_int ms))
+        in
+        set_timeout (4 * ms);
+        let res = check_timed inc in
+        set_timeout ms;
+        res
+      | res, _, _ -> res
+    in
     (match res with
      | SMT.Unsat ->
        debug_ack_command s1 (SMT.pop 1);
@@ -1427,7 +1794,9 @@ let provable ~loc ~solver ~global ~assumptions ~simp_ctxt lc =
        `False
      | SMT.Unknown ->
        debug_ack_command s1 (SMT.pop 1);
-       failwith "Unknown")
+       set_model_state No_model;
+       Cerb_metrics.incr "smt_queries_unknown";
+       raise (Unknown_result (loc, lc)))
 
 
 (* let () = Z3.Solver.reset solver.non_incremental in let () = List.iter (fun lc ->
@@ -1442,5 +1811,5 @@ let provable ~loc ~solver ~global ~assumptions ~simp_ctxt lc =
 
 (* ISD: Could these globs be different from the saved ones? *)
 let eval mo t =
-  let model_fn = Hashtbl.find models_tbl mo in
+  let model_fn = Hashtbl.find (models ()).tbl mo in
   model_fn t
@@ -20,6 +20,26 @@ val solver_flags : string list option ref
 
 val solver_type : Simple_smt.solver_extensions option ref
 
+(** Translate calls of non-recursive logical functions by inlining their
+    bodies, instead of defining each function once with [define-fun] *)
+val inline_definitions : bool ref
+
+(** Encode [Bits] values as SMT integers, with explicit wrap-around, rather
+    than as bit-vectors *)
+val int_encoding : bool ref
+
+(** Per-query time limit (in milliseconds) and resource limit *)
+val query_timeout : int option ref
+
+val query_rlimit : int option ref
+
+(** Retry an undecided query once, with a larger time limit *)
+val retry_unknown : bool ref
+
+(** Raised by [provable] when the solver cannot decide a query (e.g. because it
+    ran out of its limits) *)
+exception Unknown_result of Locations.t * LogicalConstraints.t
+
 (* Create a solver *)
 val make : Global.t -> solver
 
@@ -38,13 +58,15 @@ val num_scopes : solver -> int
 (* Resets internal state for the model evaluator *)
 val reset_model_evaluator_state : unit -> unit
 
-(* Run the solver. Note that we pass the assumptions explicitly even though they are also
-   available in the solver context, because CN is going some simplification on its own. *)
+(* Run the solver. Note that we pass the (quantified) assumptions explicitly even though
+   they are also available in the solver context, because CN instantiates them with the
+   goal's quantifier itself. The [hypotheses] are assumed for this query only. *)
 val provable
   :  loc:Locations.t ->
   solver:solver ->
   global:Global.t ->
-  assumptions:LogicalConstraints.Set.t ->
+  assumptions:LogicalConstraints.t list ->
+  ?hypotheses:IndexTerms.t list Lazy.t ->
   simp_ctxt:Simplify.simp_ctxt ->
   LogicalConstraints.t ->
   [> `True | `False ]
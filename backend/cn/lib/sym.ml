@@ -7,7 +7,10 @@ let executable_spec_enabled = ref false
 module Ord = struct
   type t = S.sym
 
-  let compare = S.symbol_compare
+  (* the same order as S.symbol_compare, but on the underlying ints directly *)
+  let compare (S.Symbol (d1, n1, _)) (S.Symbol (d2, n2, _)) =
+    let c = Int.compare d1 d2 in
+    if c <> 0 then c else Int.compare n1 n2
 end
 
 include Ord
@@ -191,6 +191,7 @@ type message =
         orig_loc : Locations.t
       }
   | Requires_after_ensures of { ens_loc : Locations.t }
+  | Solver_unknown of { constr : LC.t }
 
 type t =
   { loc : Locations.t;
@@ -540,6 +541,10 @@ let pp_message = function
     let head, pos = Locations.head_pos_of_location ens_loc in
     let descr = Some (!^"ensures clause at" ^^^ !^head ^/^ !^pos) in
     { short; descr; state = None }
+  | Solver_unknown { constr } ->
+    let short = !^"Solver could not decide constraint (unknown)" in
+    let descr = Some (!^"Constraint" ^^ colon ^^^ LC.pp constr) in
+    { short; descr; state = None }
 
 
 (** Convert a possibly-relative filepath into an absolute one. *)
@@ -670,13 +675,15 @@ let report_json
   let descr =
     match report.descr with None -> `Null | Some descr -> `String (plain descr)
   in
+  let outcome = match msg with Solver_unknown _ -> "unknown" | _ -> "error" in
   let json =
     `Assoc
       [ ("loc", Loc.json_loc loc);
         ("short", `String (plain report.short));
         ("descr", descr);
         ("state", state_error_file);
-        ("report", report_file)
+        ("report", report_file);
+        ("outcome", `String outcome)
       ]
   in
   Yojson.Safe.to_channel ~std:true stderr json
@@ -130,6 +130,8 @@ type message =
         orig_loc : Locations.t
       }
   | Requires_after_ensures of { ens_loc : Locations.t }
+  | Solver_unknown of { constr : LogicalConstraints.t }
+  (** the solver could not decide [constr] within its limits *)
 
 type t =
   { loc : Locations.t;
@@ -5,28 +5,40 @@ module LC = LogicalConstraints
 module Loc = Locations
 module IT = IndexTerms
 module ITSet = Set.Make (IT)
+module IntMap = Map.Make (Int)
 
 type solver = Solver.solver
 
+(* what may have changed, for resource unfolding, since resources were last
+   checked: the symbols constrained since, or anything *)
+type unfold_dirty =
+  | Dirty_all
+  | Dirty_syms of Sym.Set.t
+
 type s =
   { typing_context : Context.t;
     solver : solver option;
-    sym_eqs : IT.t Sym.Map.t;
-    past_models : (Solver.model_with_q * Context.t) list;
+    (* with the solver push level at which they were found *)
+    past_models : (Solver.model_with_q * int) list;
     found_equalities : EqTable.table;
     movable_indices : (Req.name * IT.t) list;
     unfold_resources_required : bool;
+    unfold_dirty : unfold_dirty;
+    (* resources (by id) that could neither be unpacked nor have anything
+       extracted, with the solver frame they were checked in *)
+    unfold_negative : int IntMap.t;
     log : Explain.log
   }
 
 let empty_s (c : Context.t) =
   { typing_context = c;
     solver = None;
-    sym_eqs = Sym.Map.empty;
     past_models = [];
     found_equalities = EqTable.empty;
     movable_indices = [];
     unfold_resources_required = false;
+    unfold_dirty = Dirty_syms Sym.Set.empty;
+    unfold_negative = IntMap.empty;
     log = []
   }
 
@@ -101,6 +113,20 @@ let lift (m : 'a Or_TypeError.t) : 'a m =
   fun s -> match m with Ok r -> Ok (r, s) | Error e -> Error e
 
 
+(* A query the solver could not decide (e.g. because it ran out of its time
+   limit) fails the current check, rather than the whole run. *)
+let catch_solver_unknown (m : 'a t) : 'a t =
+  fun s ->
+  try m s with
+  | Solver.Unknown_result (loc, constr) ->
+    Error TypeErrors.{ loc; msg = Solver_unknown { constr } }
+
+
+(** Record the cost of running [m] under [name] in the benchmark metrics. *)
+let time_phase (name : string) (m : 'a t) : 'a t =
+  fun s -> Cerb_metrics.time_phase name (fun () -> m s)
+
+
 (* end basic functions *)
 
 module Eff = Effectful.Make (struct
@@ -117,7 +143,10 @@ let iterM = Eff.ListM.iterM
 
 let make_simp_ctxt s =
   Simplify.
-    { global = s.typing_context.global; values = s.sym_eqs; simp_hook = (fun _ -> None) }
+    { global = s.typing_context.global;
+      values = Sym.Map.empty;
+      simp_hook = EqTable.representative s.found_equalities
+    }
 
 
 let simp_ctxt () =
@@ -125,16 +154,73 @@ let simp_ctxt () =
   return (make_simp_ctxt s)
 
 
+(* the separation facts of the Owned resources whose pointers mention the
+   symbols of [lc], or the terms these are known to be equal to *)
+let separation_hypotheses ({ typing_context = s; found_equalities; _ } : s) lc =
+  lazy
+    (let here = Locations.other __LOC__ in
+     let syms =
+       Sym.Map.fold
+         (fun sym bt acc ->
+           EqTable.ITSet.fold
+             (fun it acc -> Sym.Set.union (IT.free_vars it) acc)
+             (EqTable.get_eq_vals found_equalities None (IT.sym_ (sym, bt, here)))
+             acc)
+         (LC.free_vars_bts lc)
+         Sym.Set.empty
+     in
+     let facts =
+       Res.separation_facts ~relevant:(fun sym -> Sym.Set.mem sym syms) (Context.get_rs s)
+     in
+     Cerb_metrics.add "separation_facts" (List.length facts);
+     facts)
+
+
 let make_provable loc ({ typing_context = s; solver; _ } as c) =
   let simp_ctxt = make_simp_ctxt c in
   let f lc =
-    Solver.provable
-      ~loc
-      ~solver:(Option.get solver)
-      ~global:s.global
-      ~assumptions:s.constraints
-      ~simp_ctxt
-      lc
+    let known_equal =
+      match lc with
+      | LC.T it ->
+        (match IT.is_eq it with
+         | Some (x, y) -> EqTable.provably_equal c.found_equalities x y
+         | None -> false)
+      | LC.Forall _ -> false
+    in
+    if known_equal then (
+      (* already in the same class of the found equalities *)
+      Cerb_metrics.incr "smt_queries_shortcut";
+      `True)
+    else (
+      let provable hypotheses =
+        Solver.provable
+          ~loc
+          ~solver:(Option.get solver)
+          ~global:s.global
+          ~assumptions:s.quantified
+          ~hypotheses
+          ~simp_ctxt
+          lc
+      in
+      match provable (separation_hypotheses c lc) with
+      | `True -> `True
+      | `False ->
+        (* The counterexample only respects the separation facts of the
+           resources relevant to [lc]. If it breaks another one (e.g. of a
+           pointer only related to [lc] by an inequality), the query is
+           repeated with all of them, so that the models returned (and cached
+           as past models) are models of the whole context. *)
+        let all_facts = Res.separation_facts (Context.get_rs s) in
+        let holds it =
+          match Solver.eval (fst (Solver.model ())) it with
+          | Some v -> IT.is_true v
+          | None -> false
+        in
+        if List.for_all holds all_facts then
+          `False
+        else (
+          Cerb_metrics.incr "separation_facts_retried";
+          provable (lazy all_facts)))
   in
   f
 
@@ -312,12 +398,30 @@ end
 
 module WellTyped = WellTyped.Lift (ErrorReader)
 
+let mark_unfold_dirty syms =
+  modify (fun s ->
+    match s.unfold_dirty with
+    | Dirty_all -> s
+    | Dirty_syms syms' -> { s with unfold_dirty = Dirty_syms (Sym.Set.union syms syms') })
+
+
+(* Values bound to symbols join the classes of the found equalities, but
+   only constants and symbols: the solver is not told of the others, so the
+   simplifier must not rewrite them to the symbol. *)
 let add_sym_eqs sym_eqs =
+  let@ () = mark_unfold_dirty (Sym.Set.of_list (List.map fst sym_eqs)) in
+  let here = Locations.other __LOC__ in
   modify (fun s ->
-    let sym_eqs =
-      List.fold_left (fun acc (s, v) -> Sym.Map.add s v acc) s.sym_eqs sym_eqs
+    let found_equalities =
+      List.fold_left
+        (fun tab (sym, v) ->
+          match IT.get_term v with
+          | IT.Const _ | IT.Sym _ -> EqTable.add_eq tab (IT.sym_ (sym, IT.get_bt v, here)) v
+          | _ -> tab)
+        s.found_equalities
+        sym_eqs
     in
-    { s with sym_eqs })
+    { s with found_equalities })
 
 
 let get_found_equalities () = inspect (fun s -> s.found_equalities)
@@ -362,6 +466,8 @@ let rec add_ls = function
 
 let get_cs () = inspect_typing_context (fun c -> c.constraints)
 
+let get_quantified_cs () = inspect_typing_context (fun c -> c.quantified)
+
 let remove_a sym =
   let@ s = get_typing_context () in
   set_typing_context (Context.remove_a sym s)
@@ -392,28 +498,78 @@ let init_solver () =
   modify (fun s ->
     let c = s.typing_context in
     let solver = Solver.make c.global in
-    LC.Set.iter (Solver.add_assumption solver c.global) c.constraints;
+    (* replaying the log, pushing the solver up to the level of each
+       constraint, so that its scopes are in step with the context *)
+    List.iter
+      (fun (level, lc) ->
+        while Solver.num_scopes solver < level do
+          Solver.push solver
+        done;
+        Solver.add_assumption solver c.global lc)
+      (Context.constraints_in_order c);
     { s with solver = Some solver })
 
 
+(** Run [m] with [Solver.int_encoding] set to [on]. The encoding is fixed for
+    the lifetime of a solver, so if it changes, [m] runs with a new solver (and
+    without the models found by the old one), and the old one is restored after
+    it, as for [pure]. *)
+let with_int_encoding on (m : 'a t) : 'a t =
+  fun s ->
+  let outer = !Solver.int_encoding in
+  if Bool.equal on outer then
+    m s
+  else (
+    Solver.int_encoding := on;
+    let s' = { s with past_models = []; unfold_negative = IntMap.empty } in
+    let outcome =
+      match init_solver () s' with Ok ((), s') -> m s' | Error e -> Error e
+    in
+    Solver.int_encoding := outer;
+    match outcome with Ok (a, _) -> Ok (a, s) | Error e -> Error e)
+
+
 let get_movable_indices () = inspect (fun s -> s.movable_indices)
 
 let set_movable_indices ixs : unit m = modify (fun s -> { s with movable_indices = ixs })
 
-let add_c_internal lc =
+let add_simplified_c_internal lc =
   let@ _ = drop_past_models () in
   let@ s = get_typing_context () in
   let@ solver = get_solver () in
-  let@ simp_ctxt = simp_ctxt () in
-  let lc = Simplify.LogicalConstraints.simp simp_ctxt lc in
-  let s = Context.add_c lc s in
+  let s = Context.add_c ~level:(Solver.num_scopes solver) lc s in
   let () = Solver.add_assumption solver s.global lc in
-  let@ _ = add_sym_eqs (List.filter_map LC.is_sym_lhs_equality [ lc ]) in
+  let@ () =
+    match lc with
+    | LC.T _ -> mark_unfold_dirty (LC.free_vars lc)
+    | LC.Forall _ -> modify (fun s -> { s with unfold_dirty = Dirty_all })
+  in
   let@ _ = add_found_equalities lc in
   let@ () = set_typing_context s in
   return ()
 
 
+let add_c_internal lc =
+  let@ simp_ctxt = simp_ctxt () in
+  add_simplified_c_internal (Simplify.LogicalConstraints.simp simp_ctxt lc)
+
+
+(* Resource-derived facts are mostly re-derivations: every time a resource
+   is consumed and put back, its facts are derived again. Only pass the
+   solver the ones that are not trivial and not already known. *)
+let add_derived_c_internal it =
+  let@ s = get_typing_context () in
+  let@ simp_ctxt = simp_ctxt () in
+  let lc = Simplify.LogicalConstraints.simp simp_ctxt (LC.T it) in
+  Cerb_metrics.incr "pointer_facts";
+  match lc with
+  | LC.T it when IT.is_true it -> return ()
+  | _ when LC.Set.mem lc s.constraints -> return ()
+  | _ ->
+    Cerb_metrics.incr "pointer_facts_added";
+    add_simplified_c_internal lc
+
+
 let add_r_internal ?(derive_constraints = true) loc (r, Res.O oargs) =
   let@ s = get_typing_context () in
   let@ simp_ctxt = simp_ctxt () in
@@ -421,17 +577,27 @@ let add_r_internal ?(derive_constraints = true) loc (r, Res.O oargs) =
   let oargs = Simplify.IndexTerms.simp simp_ctxt oargs in
   let pointer_facts =
     if derive_constraints then
-      Res.pointer_facts ~new_resource:(r, Res.O oargs) ~old_resources:(Context.get_rs s)
+      Res.pointer_facts ~new_resource:(r, Res.O oargs)
     else
       []
   in
   let@ () = set_typing_context (Context.add_r loc (r, O oargs) s) in
-  iterM (fun x -> add_c_internal (LC.T x)) pointer_facts
+  (* the queries on its pointer now also assume its separation facts, which
+     the past models may break *)
+  let@ () =
+    match r with
+    | Req.P { name = Owned _; pointer; _ } ->
+      let@ _ = drop_past_models () in
+      mark_unfold_dirty (IT.free_vars pointer)
+    | _ -> return ()
+  in
+  iterM add_derived_c_internal pointer_facts
 
 
 let add_movable_index _loc (pred, ix) =
   let@ ixs = get_movable_indices () in
   let@ () = set_movable_indices ((pred, ix) :: ixs) in
+  let@ () = modify (fun s -> { s with unfold_dirty = Dirty_all }) in
   set_unfold_resources ()
 
 
@@ -462,8 +628,8 @@ let check_models = ref false
 let model () =
   let m = Solver.model () in
   let@ ms = get_past_models () in
-  let@ c = get_typing_context () in
-  let@ () = set_past_models ((m, c) :: ms) in
+  let@ solver = get_solver () in
+  let@ () = set_past_models ((m, Solver.num_scopes solver) :: ms) in
   return m
 
 
@@ -647,60 +813,87 @@ let map_and_fold_resources_internal loc (f : Res.t -> 'acc -> changed * 'acc) (a
 (*   inspect (fun s -> List.map (fun (pred, nm, _verb) -> (pred, nm)) s.movable_indices) *)
 
 (* the main inference loop *)
+(* Unfolding is incremental: a resource is only checked if it is new since the
+   last pass, or if it mentions a symbol related to one constrained since. The
+   resources that were found not to unfold are remembered (for the current
+   solver frame). *)
 let do_unfold_resources loc =
   let rec aux () =
     let@ s = get_typing_context () in
     let@ movable_indices = get_movable_indices () in
-    let@ _provable_f = provable_internal (Locations.other __LOC__) in
+    let@ dirty = inspect (fun s -> s.unfold_dirty) in
+    let@ negative = inspect (fun s -> s.unfold_negative) in
+    let@ frame = inspect (fun s -> Option.fold ~none:0 ~some:Solver.num_scopes s.solver) in
+    let@ () = modify (fun s -> { s with unfold_dirty = Dirty_syms Sym.Set.empty }) in
+    let dirty =
+      match dirty with
+      | Dirty_all -> None
+      | Dirty_syms syms -> Some (Context.related_syms s syms)
+    in
+    let is_candidate (re, i) =
+      match IntMap.find_opt i negative with
+      | Some frame' when frame' = frame ->
+        (match dirty with
+         | None -> true
+         | Some syms -> not (Sym.Set.disjoint syms (Res.free_vars re)))
+      | _ -> true
+    in
     let resources, orig_ix = s.resources in
-    let _orig_hist = s.resource_history in
     Pp.debug 8 (lazy (Pp.string "-- checking resource unfolds now --"));
-    let here = Locations.other __LOC__ in
-    let@ true_m = model_with_internal loc (IT.bool_ true here) in
-    match true_m with
-    | None -> return () (* contradictory state *)
-    | Some model ->
-      let@ provable_m, provable_f2 = prove_or_model_with_past_model loc model in
-      let keep, unpack, extract =
-        List.fold_right
-          (fun (re, i) (keep, unpack, extract) ->
-            match Pack.unpack loc s.global provable_f2 re with
-            | Some unpackable ->
-              let pname = Req.get_name (fst re) in
-              (keep, (i, pname, unpackable) :: unpack, extract)
-            | None ->
-              let re_reduced, extracted =
-                Pack.extractable_multiple provable_m movable_indices re
-              in
-              let keep' =
-                match extracted with
-                | [] -> (re_reduced, i) :: keep
-                | _ ->
-                  (match Pack.resource_empty provable_f2 re_reduced with
-                   | `Empty -> keep
-                   | `NonEmpty _ -> (re_reduced, i) :: keep)
-              in
-              (keep', unpack, extracted @ extract))
-          resources
-          ([], [], [])
-      in
-      let@ () = set_typing_context { s with resources = (keep, orig_ix) } in
-      let do_unpack = function
-        | _i, pname, `LRT lrt ->
-          let@ _, members =
-            make_return_record
-              loc
-              ("unpack_" ^ Pp.plain (Req.pp_name pname))
-              (LogicalReturnTypes.binders lrt)
-          in
-          bind_logical_return_internal loc members lrt
-        | _i, pname, `RES res ->
-          let is_owned = match pname with Owned _ -> true | _ -> false in
-          iterM (add_r_internal ~derive_constraints:(not is_owned) loc) res
-      in
-      let@ () = iterM do_unpack unpack in
-      let@ () = iterM (add_r_internal loc) extract in
-      (match (unpack, extract) with [], [] -> return () | _ -> aux ())
+    if not (List.exists is_candidate resources) then
+      return ()
+    else (
+      let here = Locations.other __LOC__ in
+      let@ true_m = model_with_internal loc (IT.bool_ true here) in
+      match true_m with
+      | None -> return () (* contradictory state *)
+      | Some model ->
+        let@ provable_m, provable_f2 = prove_or_model_with_past_model loc model in
+        let keep, unpack, extract, negative =
+          List.fold_right
+            (fun (re, i) (keep, unpack, extract, negative) ->
+              if not (is_candidate (re, i)) then
+                ((re, i) :: keep, unpack, extract, negative)
+              else (
+                Cerb_metrics.incr "resource_unfold_checks";
+                match Pack.unpack loc s.global provable_f2 re with
+                | Some unpackable ->
+                  let pname = Req.get_name (fst re) in
+                  (keep, (i, pname, unpackable) :: unpack, extract, IntMap.remove i negative)
+                | None ->
+                  let re_reduced, extracted =
+                    Pack.extractable_multiple provable_m movable_indices re
+                  in
+                  (match extracted with
+                   | [] -> ((re_reduced, i) :: keep, unpack, extract, IntMap.add i frame negative)
+                   | _ ->
+                     let keep' =
+                       match Pack.resource_empty provable_f2 re_reduced with
+                       | `Empty -> keep
+                       | `NonEmpty _ -> (re_reduced, i) :: keep
+                     in
+                     (keep', unpack, extracted @ extract, IntMap.remove i negative))))
+            resources
+            ([], [], [], negative)
+        in
+        let@ () = modify (fun s -> { s with unfold_negative = negative }) in
+        let@ () = set_typing_context { s with resources = (keep, orig_ix) } in
+        let do_unpack = function
+          | _i, pname, `LRT lrt ->
+            let@ _, members =
+              make_return_record
+                loc
+                ("unpack_" ^ Pp.plain (Req.pp_name pname))
+                (LogicalReturnTypes.binders lrt)
+            in
+            bind_logical_return_internal loc members lrt
+          | _i, pname, `RES res ->
+            let is_owned = match pname with Owned _ -> true | _ -> false in
+            iterM (add_r_internal ~derive_constraints:(not is_owned) loc) res
+        in
+        let@ () = iterM do_unpack unpack in
+        let@ () = iterM (add_r_internal loc) extract in
+        (match (unpack, extract) with [], [] -> return () | _ -> aux ()))
   in
   let@ () = aux () in
   modify (fun s -> { s with unfold_resources_required = false })
@@ -26,6 +26,10 @@ val pause_to_result : 'a pause -> ('a, TypeErrors.t) Result.t
 
 val sandbox : 'a t -> 'a Or_TypeError.t t
 
+val time_phase : string -> 'a m -> 'a m
+
+val catch_solver_unknown : 'a m -> 'a m
+
 val get_typing_context : unit -> Context.t m
 
 val print_with_ctxt : (Context.t -> unit) -> unit m
@@ -34,6 +38,8 @@ val get_global : unit -> Global.t m
 
 val get_cs : unit -> LogicalConstraints.Set.t m
 
+val get_quantified_cs : unit -> LogicalConstraints.t list m
+
 val simp_ctxt : unit -> Simplify.simp_ctxt m
 
 val all_resources : Locations.t -> Resource.t list m
@@ -195,4 +201,8 @@ val modify_where : (Where.t -> Where.t) -> unit m
 
 val init_solver : unit -> unit m
 
+(** Run with [Solver.int_encoding] set as given, with a new solver if this
+    changes the encoding *)
+val with_int_encoding : bool -> 'a m -> 'a m
+
 module WellTyped : WellTyped_intf.S with type 'a t := 'a t
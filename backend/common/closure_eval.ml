@@ -0,0 +1,1224 @@
+(* Closure-compiling evaluator for sequentialised Core.
+
+   Every procedure of the file is compiled once: symbols bound in its body
+   are given slots in a frame (an array), pure expressions become OCaml
+   functions of the slots, and effectful expressions become functions in
+   continuation passing style into the driver monad, calling the memory
+   model directly. The checks of the reference driver (Driver.drive) are
+   kept, including the detection of unsequenced races from the footprints of
+   the memory actions, and the errors are reported with the same locations.
+
+   The differences with the reference:
+    - only one execution is followed: the operands of unseq() are evaluated
+      from left to right, and negative actions are performed where they are
+      found (their footprint is then checked against the rest of the
+      enclosing region, like the reference does after pulling them out);
+    - no memory trace is recorded;
+    - nd(), par(), wait(), constrained values, the concurrency actions, and
+      the builtins it does not know about are not supported: [Unsupported]
+      is raised when the file is compiled, before anything is run. *)
+
+open Cerb_frontend
+open Core
+
+module ND = Nondeterminism
+
+module SymMap = Map.Make(struct
+  type t = Symbol.sym
+  let compare = Symbol.symbol_compare
+end)
+
+exception Unsupported of string
+
+let unsupported str =
+  raise (Unsupported str)
+
+(* errors of pure expressions, turned into kills of the driver by [guard] *)
+exception Pure_undef of Cerb_location.t * Undefined.undefined_behaviour list
+exception Pure_error of Cerb_location.t * string
+exception Pure_cause of Errors.core_run_cause
+
+let (>>=) = ND.nd_bind
+
+type answer = Driver.driver_result Driver.driverM
+
+
+(* Bookkeeping for the unsequenced races (see Core_reduction). The
+   footprints of the actions performed in the current scope are accumulated
+   in the frame, the scopes that are still open keep the footprints from
+   before them. *)
+type region_kind =
+  | Bound_region
+  | Sseq_region
+
+type region = {
+  kind: region_kind;
+  outer: dyn_annotation list;
+  (* negative actions unsequenced with the rest of the region *)
+  mutable pending: dyn_annotation list;
+}
+
+type unseq = {
+  mutable before: dyn_annotation list;
+}
+
+type scope =
+  | Unseq of unseq
+  | Region of region
+
+type frame = {
+  slots: value array;
+  ret: value -> answer;
+  mutable fps: dyn_annotation list;
+  (* whether an annotation was produced in the current scope (the reduction
+     of negative actions depends on it) *)
+  mutable annotated: bool;
+  (* innermost first *)
+  mutable scopes: scope list;
+}
+
+type proc = {
+  arity: int;
+  enter: value list -> (value -> answer) -> answer;
+}
+
+(* compiled effectful expressions, the boolean argument to [compile_expr]
+   tells whether the expression ends the current scope *)
+type eff = frame -> (value -> answer) -> answer
+
+type slot_env = {
+  mutable size: int;
+  mutable slot_of: int SymMap.t;
+}
+
+type proc_cx = {
+  senv: slot_env;
+  mutable labels: (int list * eff Lazy.t) SymMap.t;
+  body_annots: Annot.annot list;
+}
+
+type cx = {
+  file: Core_run.core_run_annotation Core.file;
+  core_extern: (Symbol.sym, Symbol.sym) Pmap.map;
+  mutable procs: proc Lazy.t SymMap.t;
+  mutable funs: (value list -> value) Lazy.t SymMap.t;
+  impl_funs: (Implementation.implementation_constant, (value list -> value) Lazy.t) Hashtbl.t;
+  impl_defs: (Implementation.implementation_constant, value Lazy.t) Hashtbl.t;
+  (* the values of the globals, set once they have been evaluated *)
+  mutable globals: value option ref SymMap.t;
+  mutable tid: Mem_common.thread_id;
+  mutable loc: Cerb_location.t;
+  mutable call_loc: Cerb_location.t;
+  mutable mem_st: Impl_mem.mem_state;
+  mutable errno: Impl_mem.pointer_value;
+  mutable excl_counter: int;
+}
+
+let new_slot_env () =
+  { size= 0; slot_of= SymMap.empty }
+
+let slot senv sym =
+  match SymMap.find_opt sym senv.slot_of with
+    | Some i ->
+        i
+    | None ->
+        let i = senv.size in
+        senv.size <- i + 1;
+        senv.slot_of <- SymMap.add sym i senv.slot_of;
+        i
+
+let value_pe cval =
+  Pexpr ([], (), PEval cval)
+
+let bool_value b =
+  if b then Vtrue else Vfalse
+
+let source_loc annots =
+  match Annot.get_loc annots with
+    | Some loc when not (Cerb_location.is_library_location loc) ->
+        Some loc
+    | _ ->
+        None
+
+let set_loc cx = function
+  | Some loc -> cx.loc <- loc
+  | None -> ()
+
+let eval_list fs slots =
+  List.map (fun f -> f slots) fs
+
+(* falling back to the reference evaluator on a node whose operands have
+   already been evaluated *)
+let reference cx pe_ =
+  match Core_eval.eval_pexpr cx.loc (Some cx.call_loc) cx.core_extern [] (Some cx.mem_st) cx.file (Pexpr ([], (), pe_)) with
+    | Either.Right (Undefined.Defined cval) ->
+        cval
+    | Either.Right (Undefined.Undef (loc, ubs)) ->
+        raise (Pure_undef (loc, ubs))
+    | Either.Right (Undefined.Error (loc, str)) ->
+        raise (Pure_error (loc, str))
+    | Either.Left (_, Errors.CORE_RUN cause) ->
+        raise (Pure_cause cause)
+    | Either.Left err ->
+        failwith (Pp_errors.to_string err)
+
+let guard f k =
+  match f () with
+    | cval ->
+        k cval
+    | exception Pure_undef (loc, ubs) ->
+        ND.kill (ND.Undef0 (loc, ubs))
+    | exception Pure_error (loc, str) ->
+        ND.kill (ND.Error0 (loc, str))
+    | exception Pure_cause cause ->
+        ND.kill (ND.Other (Driver.DErr_core_run cause))
+
+let eval f slots k =
+  guard (fun () -> f slots) k
+
+let eval_all fs slots k =
+  guard (fun () -> eval_list fs slots) k
+
+(* runs a driver computation that may have changed the memory state *)
+let sync cx m =
+  m >>= fun z ->
+  ND.nd_read (fun dr_st -> cx.mem_st <- dr_st.Driver.layout_state; z)
+
+let mem cx m k =
+  sync cx (Driver.liftMem m) >>= k
+
+let current_thread cx =
+  Driver.get_thread_states >>= fun th_sts ->
+  match List.assoc_opt cx.tid th_sts with
+    | Some (_, th_st) ->
+        ND.nd_return th_st
+    | None ->
+        failwith "Closure_eval: the main thread is gone"
+
+let finish cval =
+  ND.nd_update (fun dr_st ->
+    { dr_st with Driver.core_state= Driver.prepare_exit dr_st.Driver.core_state cval }
+  ) >>= fun () ->
+  ND.nd_get >>= fun dr_st ->
+  ND.nd_return (Driver.finalize "drive (closure evaluator)" dr_st)
+
+let illtyped str =
+  failwith ("Driver.advance_step => Step_error2: " ^ str)
+
+let bind_pattern m slots cval =
+  if not (m slots cval) then
+    failwith "Core_aux.update_env_aux: the pattern didn't match"
+
+let kill_race cx =
+  ND.kill (ND.Undef0 (cx.loc, [Undefined.UB035_unsequenced_race]))
+
+
+(* Races *)
+let exclude n = function
+  | DA_neg (id, excl, fp) ->
+      DA_neg (id, n :: excl, fp)
+  | DA_pos (excl, fp) ->
+      DA_pos (n :: excl, fp)
+
+let rec pairwise_race = function
+  | [] ->
+      false
+  | x :: xs ->
+      Core_reduction.do_race [x] xs || pairwise_race xs
+
+let races r fps =
+  Core_reduction.do_race r.pending fps || pairwise_race r.pending
+
+(* As Core_reduction.break_at_bound_and_sseq: a negative action is
+   unsequenced with the rest of the innermost strong sequencing inside the
+   outermost bound, or else with the rest of that bound. Returns the scopes
+   opened inside that region (only unseqs) and the region. *)
+let negative_target fr what =
+  let bounds = List.filter (function
+    | Region { kind= Bound_region; _ } -> true
+    | _ -> false
+  ) fr.scopes in
+  match bounds with
+    | [] ->
+        failwith ("TODO: NO_BOUND (" ^ what ^ ")")
+    | _ :: _ :: _ ->
+        failwith "break_at_sseq, Cbound"
+    | _ ->
+        let rec find inner = function
+          | Region r :: _ ->
+              (List.rev inner, r)
+          | scope :: scopes ->
+              find (scope :: inner) scopes
+          | [] ->
+              assert false in
+        find [] fr.scopes
+
+let exclude_in n fr inner =
+  fr.fps <- List.map (exclude n) fr.fps;
+  List.iter (function
+    | Unseq u -> u.before <- List.map (exclude n) u.before
+    | Region _ -> ()
+  ) inner
+
+let fresh_excl cx =
+  let n = cx.excl_counter in
+  cx.excl_counter <- n + 1;
+  n
+
+
+(* Procedure calls (see Core_run.call_proc) *)
+let resolve_proc cx psym =
+  match Pmap.lookup psym cx.file.stdlib with
+    | Some (Proc _) ->
+        SymMap.find_opt psym cx.procs
+    | _ ->
+        let sym = match Pmap.lookup psym cx.core_extern with
+          | Some sym -> sym
+          | None -> psym in
+        begin match Pmap.lookup sym cx.file.funs with
+          | Some (Proc _) ->
+              SymMap.find_opt sym cx.procs
+          | _ ->
+              None
+        end
+
+let call cx psym p_opt cvals k =
+  match p_opt with
+    | None ->
+        ND.kill (ND.Other (Driver.DErr_core_run
+          (Errors.Illformed_program ("calling an unknown procedure: " ^ Symbol.show_symbol psym))))
+    | Some p ->
+        let p = Lazy.force p in
+        let n = List.length cvals in
+        if n <> p.arity then
+          ND.kill (ND.Other (Driver.DErr_core_run (Errors.Illformed_program
+            ("calling procedure `" ^ Symbol.show_symbol psym ^
+             "' with the wrong number of args: |args|=" ^ string_of_int n ^
+             "expecting: " ^ string_of_int p.arity))))
+        else begin
+          (* the location of the call, for UB088 in the callee, and restored
+             when it returns for the rest of the caller *)
+          let caller_call_loc = cx.call_loc in
+          cx.call_loc <- cx.loc;
+          (* yielding to the driver monad before entering the body *)
+          ND.nd_return () >>= fun () ->
+          p.enter cvals (fun cval -> cx.call_loc <- caller_call_loc; k cval)
+        end
+
+
+(* Compilation *)
+let rec compile_pattern senv (Pattern (_, pat)) : value array -> value -> bool =
+  match pat with
+    | CaseBase (None, _) ->
+        fun _ _ -> true
+    | CaseBase (Some sym, _) ->
+        let i = slot senv sym in
+        fun slots cval -> slots.(i) <- cval; true
+    | CaseCtor (Cspecified, [pat']) ->
+        let m = compile_pattern senv pat' in
+        fun slots -> begin function
+          | Vloaded (LVspecified oval) -> m slots (Vobject oval)
+          | _ -> false
+        end
+    | CaseCtor (Cunspecified, [pat']) ->
+        let m = compile_pattern senv pat' in
+        fun slots -> begin function
+          | Vloaded (LVunspecified ty) -> m slots (Vctype ty)
+          | _ -> false
+        end
+    | CaseCtor (Ctuple, pats) ->
+        let ms = List.map (compile_pattern senv) pats in
+        fun slots -> begin function
+          | Vtuple cvals when List.compare_lengths ms cvals = 0 ->
+              List.for_all2 (fun m cval -> m slots cval) ms cvals
+          | _ ->
+              false
+        end
+    | CaseCtor (Cnil _, []) ->
+        fun _ -> begin function
+          | Vlist (_, []) -> true
+          | _ -> false
+        end
+    | CaseCtor (Ccons, [pat_x; pat_xs]) ->
+        let m_x = compile_pattern senv pat_x in
+        let m_xs = compile_pattern senv pat_xs in
+        fun slots -> begin function
+          | Vlist (bTy, cval :: cvals) -> m_x slots cval && m_xs slots (Vlist (bTy, cvals))
+          | _ -> false
+        end
+    | CaseCtor _ ->
+        fun _ _ -> false
+
+let rec compile_pexpr cx senv (Pexpr (_, _, pe_)) : value array -> value =
+  let self = compile_pexpr cx senv in
+  (* evaluating the operands, and then the node with the reference *)
+  let fallback pes mk =
+    let fs = List.map self pes in
+    fun slots -> reference cx (mk (List.map value_pe (eval_list fs slots))) in
+  match pe_ with
+    | PEval cval ->
+        fun _ -> cval
+    | PEsym sym ->
+        begin match SymMap.find_opt sym senv.slot_of with
+          | Some i ->
+              fun slots -> slots.(i)
+          | None ->
+              global cx sym
+        end
+    | PEimpl iCst ->
+        let cval = impl_def cx iCst in
+        fun _ -> Lazy.force cval
+    | PEconstrained _ ->
+        unsupported "constrained value"
+    | PEundef (undef_loc, ub) ->
+        fun _ ->
+          let loc = match ub with
+            | Undefined.UB088_reached_end_of_function ->
+                cx.call_loc
+            | _ ->
+                if Cerb_location.is_library_location undef_loc then cx.loc else undef_loc in
+          raise (Pure_undef (loc, [ub]))
+    | PEerror (str, _) ->
+        fun _ -> raise (Pure_error (cx.loc, str))
+    | PEctor (ctor, pes) ->
+        let fs = List.map self pes in
+        let generic cvals = reference cx (PEctor (ctor, List.map value_pe cvals)) in
+        begin match (ctor, fs) with
+          | (Cspecified, [f]) ->
+              fun slots -> begin match f slots with
+                | Vobject oval -> Vloaded (LVspecified oval)
+                | cval -> generic [cval]
+              end
+          | (Cunspecified, [f]) ->
+              fun slots -> begin match f slots with
+                | Vctype ty -> Vloaded (LVunspecified ty)
+                | cval -> generic [cval]
+              end
+          | (Ctuple, _) ->
+              fun slots -> Vtuple (eval_list fs slots)
+          | (Cnil bTy, []) ->
+              fun _ -> Vlist (bTy, [])
+          | (Ccons, [f1; f2]) ->
+              fun slots ->
+                let cval1 = f1 slots in
+                begin match f2 slots with
+                  | Vlist (bTy, cvals) -> Vlist (bTy, cval1 :: cvals)
+                  | cval2 -> generic [cval1; cval2]
+                end
+          | _ ->
+              fun slots -> generic (eval_list fs slots)
+        end
+    | PEcase (pe, pat_pes) ->
+        let f = self pe in
+        let branches = List.map (fun (pat, pe') ->
+          let m = compile_pattern senv pat in
+          (m, self pe')
+        ) pat_pes in
+        fun slots ->
+          let cval = f slots in
+          let rec select = function
+            | [] ->
+                reference cx (PEcase (value_pe cval, pat_pes))
+            | (m, f') :: branches' ->
+                if m slots cval then f' slots else select branches' in
+          select branches
+    | PEarray_shift (pe1, ty, pe2) ->
+        let f1 = self pe1 in
+        let f2 = self pe2 in
+        fun slots ->
+          let cval1 = f1 slots in
+          let cval2 = f2 slots in
+          begin match (cval1, cval2) with
+            | (Vobject (OVpointer ptrval), Vobject (OVinteger ival)) ->
+                Vobject (OVpointer (Impl_mem.array_shift_ptrval ptrval ty ival))
+            | _ ->
+                reference cx (PEarray_shift (value_pe cval1, ty, value_pe cval2))
+          end
+    | PEmember_shift (pe, tag_sym, memb_ident) ->
+        let f = self pe in
+        fun slots ->
+          begin match f slots with
+            | Vobject (OVpointer ptrval) ->
+                Vobject (OVpointer (Impl_mem.member_shift_ptrval ptrval tag_sym memb_ident))
+            | cval ->
+                reference cx (PEmember_shift (value_pe cval, tag_sym, memb_ident))
+          end
+    | PEmemop (memop, pes) ->
+        fallback pes (fun pes' -> PEmemop (memop, pes'))
+    | PEnot pe ->
+        let f = self pe in
+        fun slots ->
+          begin match f slots with
+            | Vtrue -> Vfalse
+            | Vfalse -> Vtrue
+            | _ -> raise (Pure_cause (Errors.Illformed_program "PEnot: operand should be a boolean"))
+          end
+    | PEop (bop, pe1, pe2) ->
+        let f1 = self pe1 in
+        let f2 = self pe2 in
+        let int_cmp = match bop with
+          | OpEq -> Some Impl_mem.eq_ival
+          | OpLt -> Some Impl_mem.lt_ival
+          | OpLe -> Some Impl_mem.le_ival
+          | OpGt -> Some (fun ival1 ival2 -> Impl_mem.lt_ival ival2 ival1)
+          | OpGe -> Some (fun ival1 ival2 -> Impl_mem.le_ival ival2 ival1)
+          | _ -> None in
+        let int_op = match bop with
+          | OpAdd -> Some Mem_common.IntAdd
+          | OpSub -> Some Mem_common.IntSub
+          | OpMul -> Some Mem_common.IntMul
+          | OpDiv -> Some Mem_common.IntDiv
+          | OpRem_t -> Some Mem_common.IntRem_t
+          | OpRem_f -> Some Mem_common.IntRem_f
+          | OpExp -> Some Mem_common.IntExp
+          | _ -> None in
+        fun slots ->
+          let cval1 = f1 slots in
+          let cval2 = f2 slots in
+          let generic () = reference cx (PEop (bop, value_pe cval1, value_pe cval2)) in
+          begin match (cval1, cval2) with
+            | (Vobject (OVinteger ival1), Vobject (OVinteger ival2)) ->
+                begin match (int_cmp, int_op) with
+                  | (Some cmp, _) ->
+                      begin match cmp ival1 ival2 with
+                        | Some b -> bool_value b
+                        | None -> generic ()
+                      end
+                  | (None, Some iop) ->
+                      Vobject (OVinteger (Impl_mem.op_ival iop ival1 ival2))
+                  | (None, None) ->
+                      generic ()
+                end
+            | ((Vtrue | Vfalse), (Vtrue | Vfalse)) when bop = OpAnd ->
+                bool_value (cval1 = Vtrue && cval2 = Vtrue)
+            | ((Vtrue | Vfalse), (Vtrue | Vfalse)) when bop = OpOr ->
+                bool_value (cval1 = Vtrue || cval2 = Vtrue)
+            | _ ->
+                generic ()
+          end
+    | PEconv_int (ity, pe) ->
+        let f = self pe in
+        fun slots ->
+          begin match f slots with
+            | Vobject (OVinteger ival) ->
+                Vobject (OVinteger (Core_eval.mk_conv_int ity ival))
+            | cval ->
+                reference cx (PEconv_int (ity, value_pe cval))
+          end
+    | PEwrapI (ity, iop, pe1, pe2) ->
+        let f1 = self pe1 in
+        let f2 = self pe2 in
+        fun slots ->
+          let cval1 = f1 slots in
+          let cval2 = f2 slots in
+          begin match (cval1, cval2) with
+            | (Vobject (OVinteger ival1), Vobject (OVinteger ival2)) ->
+                Vobject (OVinteger (Core_eval.mk_wrapI_op ity iop ival1 ival2))
+            | _ ->
+                reference cx (PEwrapI (ity, iop, value_pe cval1, value_pe cval2))
+          end
+    | PEcatch_exceptional_condition (ity, iop, pe1, pe2) ->
+        let f1 = self pe1 in
+        let f2 = self pe2 in
+        fun slots ->
+          let cval1 = f1 slots in
+          let cval2 = f2 slots in
+          begin match (cval1, cval2) with
+            | (Vobject (OVinteger ival1), Vobject (OVinteger ival2)) ->
+                begin match Core_eval.mk_call_catch_exceptional_condition ity iop ival1 ival2 with
+                  | Some ival ->
+                      Vobject (OVinteger ival)
+                  | None ->
+                      raise (Pure_undef (cx.loc, [Undefined.UB036_exceptional_condition]))
+                end
+            | _ ->
+                reference cx (PEcatch_exceptional_condition (ity, iop, value_pe cval1, value_pe cval2))
+          end
+    | PEstruct (tag_sym, ident_pes) ->
+        let idents = List.map fst ident_pes in
+        fallback (List.map snd ident_pes) (fun pes' -> PEstruct (tag_sym, List.combine idents pes'))
+    | PEunion (tag_sym, memb_ident, pe) ->
+        fallback [pe] (fun pes' -> PEunion (tag_sym, memb_ident, List.hd pes'))
+    | PEcfunction pe ->
+        fallback [pe] (fun pes' -> PEcfunction (List.hd pes'))
+    | PEmemberof (tag_sym, memb_ident, pe) ->
+        fallback [pe] (fun pes' -> PEmemberof (tag_sym, memb_ident, List.hd pes'))
+    | PEcall (nm, pes) ->
+        let fs = List.map self pes in
+        let g = pure_fun cx nm in
+        fun slots -> g (eval_list fs slots)
+    | PElet (pat, pe1, pe2) ->
+        let f1 = self pe1 in
+        let m = compile_pattern senv pat in
+        let f2 = self pe2 in
+        fun slots ->
+          let cval = f1 slots in
+          if m slots cval then
+            f2 slots
+          else
+            reference cx (PElet (pat, value_pe cval, pe2))
+    | PEif (pe1, pe2, pe3) ->
+        let f1 = self pe1 in
+        let f2 = self pe2 in
+        let f3 = self pe3 in
+        fun slots ->
+          begin match f1 slots with
+            | Vtrue -> f2 slots
+            | Vfalse -> f3 slots
+            | cval -> reference cx (PEif (value_pe cval, value_pe Vunit, value_pe Vunit))
+          end
+    | PEis_scalar pe ->
+        fallback [pe] (fun pes' -> PEis_scalar (List.hd pes'))
+    | PEis_integer pe ->
+        fallback [pe] (fun pes' -> PEis_integer (List.hd pes'))
+    | PEis_signed pe ->
+        fallback [pe] (fun pes' -> PEis_signed (List.hd pes'))
+    | PEis_unsigned pe ->
+        fallback [pe] (fun pes' -> PEis_unsigned (List.hd pes'))
+    | PEbmc_assume pe ->
+        fallback [pe] (fun pes' -> PEbmc_assume (List.hd pes'))
+    | PEare_compatible (pe1, pe2) ->
+        fallback [pe1; pe2] (fun pes' -> PEare_compatible (List.hd pes', List.nth pes' 1))
+
+and global cx sym =
+  let sym = match Pmap.lookup sym cx.core_extern with
+    | Some sym' -> sym'
+    | None -> sym in
+  let r = match SymMap.find_opt sym cx.globals with
+    | Some r ->
+        r
+    | None ->
+        let r = ref None in
+        cx.globals <- SymMap.add sym r cx.globals;
+        r in
+  let is_proc = match Pmap.lookup sym cx.file.funs with
+    | Some (Proc _) -> true
+    | _ -> false in
+  fun _ ->
+    match !r with
+      | Some cval ->
+          cval
+      | None ->
+          (* NOTE: as Core_eval, an undefined procedure symbol is a null pointer *)
+          if is_proc then
+            Vobject (OVpointer (Impl_mem.null_ptrval (Ctype.Ctype ([], Ctype.Void))))
+          else
+            raise (Pure_cause (Errors.Unresolved_symbol (cx.loc, sym)))
+
+and impl_def cx iCst =
+  match Hashtbl.find_opt cx.impl_defs iCst with
+    | Some cval ->
+        cval
+    | None ->
+        let cval = match Pmap.lookup iCst cx.file.impl with
+          | Some (Def (_, pe)) ->
+              let senv = new_slot_env () in
+              let f = compile_pexpr cx senv pe in
+              lazy (f (Array.make senv.size Vunit))
+          | _ ->
+              lazy (raise (Pure_cause Errors.Unknown_impl)) in
+        Hashtbl.add cx.impl_defs iCst cval;
+        cval
+
+and compile_fun cx params body =
+  let senv = new_slot_env () in
+  let idxs = List.map (fun (sym, _) -> slot senv sym) params in
+  let f = compile_pexpr cx senv body in
+  let arity = List.length idxs in
+  fun cvals ->
+    let n = List.length cvals in
+    if n <> arity then
+      failwith ("CALL() |params|= " ^ string_of_int arity ^ " <> |args|= " ^ string_of_int n);
+    let slots = Array.make senv.size Vunit in
+    List.iter2 (fun i cval -> slots.(i) <- cval) idxs cvals;
+    f slots
+
+(* the table entry is added before the body is compiled, for recursive
+   functions *)
+and pure_fun cx = function
+  | Sym f ->
+      let decl = match Pmap.lookup f cx.file.stdlib with
+        | Some decl -> Some decl
+        | None -> Pmap.lookup f cx.file.funs in
+      begin match decl with
+        | Some (Fun (_, params, body)) ->
+            let g = match SymMap.find_opt f cx.funs with
+              | Some g ->
+                  g
+              | None ->
+                  let g = lazy (compile_fun cx params body) in
+                  cx.funs <- SymMap.add f g cx.funs;
+                  ignore (Lazy.force g);
+                  g in
+            fun cvals -> Lazy.force g cvals
+        | Some (Proc _) ->
+            fun _ -> failwith "Core_eval.call_function, called on a Proc"
+        | Some (ProcDecl _) ->
+            fun _ -> failwith "Core_eval.call_function, called on a ProcDecl"
+        | Some (BuiltinDecl _) ->
+            fun _ -> failwith "Core_eval.call_function, called on a BuiltinDecl"
+        | None ->
+            fun _ -> raise (Pure_cause (Errors.Illformed_program "calling an unknown function"))
+      end
+  | Impl iCst ->
+      begin match Pmap.lookup iCst cx.file.impl with
+        | Some (IFun (_, params, body)) ->
+            let g = match Hashtbl.find_opt cx.impl_funs iCst with
+              | Some g ->
+                  g
+              | None ->
+                  let g = lazy (compile_fun cx params body) in
+                  Hashtbl.add cx.impl_funs iCst g;
+                  ignore (Lazy.force g);
+                  g in
+            fun cvals -> Lazy.force g cvals
+        | _ ->
+            fun _ -> raise (Pure_cause (Errors.Illformed_program
+              ("calling an unknown impl-function: " ^ Implementation.string_of_implementation_constant iCst)))
+      end
+
+let builtin_int_op = function
+  | "generic_ffs" -> Some Ocaml_gcc_builtins.generic_ffs
+  | "ctz" -> Some Ocaml_gcc_builtins.ctz
+  | "bswap16" -> Some Ocaml_gcc_builtins.bswap16
+  | "bswap32" -> Some Ocaml_gcc_builtins.bswap32
+  | "bswap64" -> Some Ocaml_gcc_builtins.bswap64
+  | _ -> None
+
+(* the file system builtins are the whole body of their stdlib procedure,
+   and Driver.drive_fs_step replaces the arena with their result *)
+let fs_call cx pcx iCst cvals fr =
+  current_thread cx >>= fun th_st ->
+  let th_st' =
+    { th_st with Core_run.arena= Expr (pcx.body_annots, Epure (value_pe Vunit));
+                 Core_run.current_loc= cx.loc } in
+  let oper = Core_reduction_aux.step_fs_proc th_st' iCst cvals in
+  ND.nd_get >>= fun dr_st ->
+  sync cx (Driver.drive_fs_step cx.tid th_st' dr_st oper) >>= fun () ->
+  current_thread cx >>= fun th_st ->
+  match th_st.Core_run.arena with
+    | Expr (_, Epure (Pexpr (_, _, PEval cval))) ->
+        fr.ret cval
+    | Expr (annots, Epure (Pexpr (_, _, pe_))) ->
+        set_loc cx (source_loc annots);
+        guard (fun () -> reference cx pe_) fr.ret
+    | _ ->
+        failwith "Closure_eval: unexpected arena after a file system step"
+
+let rec compile_expr cx pcx tail (Expr (annots, expr_)) : eff =
+  let senv = pcx.senv in
+  let pure = compile_pexpr cx senv in
+  let loc_opt = source_loc annots in
+  match expr_ with
+    | Epure (Pexpr (_, _, PEval cval)) ->
+        fun _ k -> k cval
+    | Epure pe ->
+        let f = pure pe in
+        fun fr k ->
+          set_loc cx loc_opt;
+          eval f fr.slots k
+    | Ememop (memop, pes) ->
+        let fs = List.map pure pes in
+        fun fr k ->
+          set_loc cx loc_opt;
+          eval_all fs fr.slots (fun cvals ->
+            current_thread cx >>= fun th_st ->
+            let res = ref Vunit in
+            sync cx (Driver.perform_memop_request2 cx.loc memop cvals cx.tid (fun cval -> res := cval; th_st)) >>= fun () ->
+            k !res
+          )
+    | Eaction (Paction (pol, Action (act_loc, _, act))) ->
+        compile_action cx pcx tail annots loc_opt pol act_loc act
+    | Ecase (pe, pat_es) ->
+        let f = pure pe in
+        let branches = List.map (fun (pat, e) ->
+          let m = compile_pattern senv pat in
+          (m, compile_expr cx pcx tail e)
+        ) pat_es in
+        fun fr k ->
+          set_loc cx loc_opt;
+          eval f fr.slots (fun cval ->
+            let rec select = function
+              | [] ->
+                  illtyped "Ecase, mismatched"
+              | (m, c) :: branches' ->
+                  if m fr.slots cval then c fr k else select branches' in
+            select branches
+          )
+    | Elet (pat, pe, e) ->
+        let f = pure pe in
+        let m = compile_pattern senv pat in
+        let c = compile_expr cx pcx tail e in
+        fun fr k ->
+          set_loc cx loc_opt;
+          eval f fr.slots (fun cval ->
+            bind_pattern m fr.slots cval;
+            c fr k
+          )
+    | Eif (pe, e1, e2) ->
+        let f = pure pe in
+        let c1 = compile_expr cx pcx tail e1 in
+        let c2 = compile_expr cx pcx tail e2 in
+        fun fr k ->
+          set_loc cx loc_opt;
+          eval f fr.slots (function
+            | Vtrue ->
+                c1 fr k
+            | Vfalse ->
+                c2 fr k
+            | _ ->
+                failwith "TODO(use the core_runM) ILLTYPED, the first operand of an Eif didn't evaluated to a boolean"
+          )
+    | Eccall (_, _, pe, pes) ->
+        let f = pure pe in
+        let fs = List.map pure pes in
+        fun fr k ->
+          set_loc cx loc_opt;
+          eval f fr.slots (function
+            | Vloaded (LVspecified (OVpointer ptrval)) ->
+                eval_all fs fr.slots (fun cvals ->
+                  let case_funptrval = function
+                    | None ->
+                        ND.kill (ND.Undef0 (cx.loc, [Undefined.UB_CERB003_invalid_function_pointer]))
+                    | Some psym ->
+                        call cx psym (resolve_proc cx psym) cvals k in
+                  Impl_mem.case_ptrval ptrval
+                    (fun _ -> failwith "null function pointer")
+                    case_funptrval
+                    (fun _ _ -> case_funptrval (Impl_mem.case_funsym_opt cx.mem_st ptrval))
+                )
+            | _ ->
+                failwith "TODO(use core_runM) Eccall illtyped first operand"
+          )
+    | Eproc (_, Sym psym, pes) ->
+        let fs = List.map pure pes in
+        let p_opt = resolve_proc cx psym in
+        fun fr k ->
+          set_loc cx loc_opt;
+          eval_all fs fr.slots (fun cvals -> call cx psym p_opt cvals k)
+    | Eproc (_, Impl iCst, pes) ->
+        let fs = List.map pure pes in
+        if Core_reduction_aux.is_fs_function iCst then
+          fun fr _ ->
+            set_loc cx loc_opt;
+            eval_all fs fr.slots (fun cvals -> fs_call cx pcx iCst cvals fr)
+        else begin match (iCst, fs) with
+          | (Implementation.BuiltinFunction "errno", []) ->
+              fun _ k ->
+                set_loc cx loc_opt;
+                k (Vloaded (LVspecified (OVpointer cx.errno)))
+          | (Implementation.BuiltinFunction "exit", [f]) ->
+              fun fr _ ->
+                set_loc cx loc_opt;
+                eval f fr.slots finish
+          | (Implementation.BuiltinFunction name, [f]) when Option.is_some (builtin_int_op name) ->
+              let op = Option.get (builtin_int_op name) in
+              fun fr k ->
+                set_loc cx loc_opt;
+                eval f fr.slots (function
+                  | Vobject (OVinteger ival) ->
+                      begin match Mem_aux.integerFromIntegerValue ival with
+                        | Some n ->
+                            k (Vloaded (LVspecified (OVinteger (Impl_mem.integer_ival (op n)))))
+                        | None ->
+                            failwith name
+                      end
+                  | _ ->
+                      failwith ("TODO: " ^ name ^ " illtyped")
+                )
+          | _ ->
+              unsupported ("builtin " ^ Implementation.string_of_implementation_constant iCst)
+        end
+    | Eunseq es ->
+        let cs = List.map (compile_expr cx pcx true) es in
+        fun fr k ->
+          let u = { before= fr.fps } in
+          let scopes = fr.scopes in
+          fr.scopes <- Unseq u :: scopes;
+          let rec run acc = function
+            | [] ->
+                fr.scopes <- scopes;
+                set_loc cx loc_opt;
+                let results = List.rev acc in
+                (* as Core_reduction.one_step_unseq_aux *)
+                let rec check fps_acc = function
+                  | [] ->
+                      Some fps_acc
+                  | fps :: fpss ->
+                      if Core_reduction.do_race fps fps_acc then None else check (fps @ fps_acc) fpss in
+                begin match check [] (List.map fst results) with
+                  | None ->
+                      kill_race cx
+                  | Some fps ->
+                      fr.fps <- fps @ u.before;
+                      fr.annotated <- true;
+                      k (Vtuple (List.map snd results))
+                end
+            | c :: cs' ->
+                fr.fps <- [];
+                fr.annotated <- false;
+                c fr (fun cval -> run ((fr.fps, cval) :: acc) cs') in
+          run [] cs
+    | Ewseq (pat, e1, e2) ->
+        let c1 = compile_expr cx pcx false e1 in
+        let m = compile_pattern senv pat in
+        let c2 = compile_expr cx pcx tail e2 in
+        fun fr k ->
+          c1 fr (fun cval ->
+            set_loc cx loc_opt;
+            bind_pattern m fr.slots cval;
+            c2 fr k
+          )
+    | Esseq (pat, e1, e2) ->
+        let c1 = compile_expr cx pcx true e1 in
+        let m = compile_pattern senv pat in
+        let c2 = compile_expr cx pcx tail e2 in
+        fun fr k ->
+          let r = { kind= Sseq_region; outer= fr.fps; pending= [] } in
+          let annotated = fr.annotated in
+          let scopes = fr.scopes in
+          fr.scopes <- Region r :: scopes;
+          fr.fps <- [];
+          fr.annotated <- false;
+          c1 fr (fun cval ->
+            fr.scopes <- scopes;
+            if races r fr.fps then
+              kill_race cx
+            else begin
+              fr.fps <- r.outer @ fr.fps @ r.pending;
+              fr.annotated <- annotated || fr.annotated;
+              set_loc cx loc_opt;
+              bind_pattern m fr.slots cval;
+              c2 fr k
+            end
+          )
+    | Ebound e ->
+        let c = compile_expr cx pcx true e in
+        fun fr k ->
+          let r = { kind= Bound_region; outer= fr.fps; pending= [] } in
+          let annotated = fr.annotated in
+          let scopes = fr.scopes in
+          fr.scopes <- Region r :: scopes;
+          fr.fps <- [];
+          fr.annotated <- false;
+          c fr (fun cval ->
+            fr.scopes <- scopes;
+            if races r fr.fps then
+              kill_race cx
+            else begin
+              (* the footprints do not escape the bound *)
+              fr.fps <- r.outer;
+              fr.annotated <- annotated;
+              set_loc cx loc_opt;
+              k cval
+            end
+          )
+    | Esave (_, params, e) ->
+        let idxs = List.map (fun (sym, _) -> slot senv sym) params in
+        let fs = List.map (fun (_, (_, pe)) -> pure pe) params in
+        let c = compile_expr cx pcx tail e in
+        fun fr k ->
+          set_loc cx loc_opt;
+          eval_all fs fr.slots (fun cvals ->
+            List.iter2 (fun i cval -> fr.slots.(i) <- cval) idxs cvals;
+            c fr k
+          )
+    | Erun (_, label, pes) ->
+        let fs = List.map pure pes in
+        begin match SymMap.find_opt label pcx.labels with
+          | None ->
+              fun _ _ -> failwith ("Erun couldn't resolve label: `" ^ Symbol.show_symbol label ^ "'")
+          | Some (idxs, cont) ->
+              fun fr _ ->
+                set_loc cx loc_opt;
+                eval_all fs fr.slots (fun cvals ->
+                  List.iter2 (fun i cval -> fr.slots.(i) <- cval) idxs cvals;
+                  (* the continuation replaces the whole body *)
+                  fr.fps <- [];
+                  fr.annotated <- false;
+                  fr.scopes <- [];
+                  ND.nd_return () >>= fun () ->
+                  Lazy.force cont fr fr.ret
+                )
+        end
+    | End _ ->
+        unsupported "nd()"
+    | Epar _ ->
+        unsupported "par()"
+    | Ewait _ ->
+        unsupported "wait()"
+    | Eannot _
+    | Eexcluded _ ->
+        unsupported "runtime only construct"
+
+and compile_action cx pcx tail annots loc_opt pol act_loc act : eff =
+  let pure = compile_pexpr cx pcx.senv in
+  let mem_loc () =
+    if Cerb_location.is_library_location act_loc then cx.loc else act_loc in
+  let lvalue_ty ty = Ctype.Ctype ([], Ctype.unatomic_ ty) in
+  (* performing the action, giving its value and footprint *)
+  let perform : (frame -> (value -> Impl_mem.footprint option -> answer) -> answer) =
+    match act with
+      | Create (pe1, pe2, pref) ->
+          let fs = [pure pe1; pure pe2] in
+          let addr_opt = Cerb_attributes.get_with_address annots in
+          fun fr k ->
+            eval_all fs fr.slots (function
+              | [Vobject (OVinteger ival); Vctype ty] ->
+                  mem cx (Impl_mem.allocate_object cx.tid pref ival ty addr_opt None) (fun ptrval ->
+                    k (Vobject (OVpointer ptrval)) None)
+              | _ ->
+                  illtyped "Create"
+            )
+      | CreateReadOnly (pe1, pe2, pe3, pref) ->
+          let fs = [pure pe1; pure pe2; pure pe3] in
+          let addr_opt = Cerb_attributes.get_with_address annots in
+          fun fr k ->
+            eval_all fs fr.slots (function
+              | [Vobject (OVinteger ival); Vctype ty; cval] ->
+                  begin match Core_aux.memValueFromValue (lvalue_ty ty) cval with
+                    | Some mval ->
+                        mem cx (Impl_mem.allocate_object cx.tid pref ival ty addr_opt (Some mval)) (fun ptrval ->
+                          k (Vobject (OVpointer ptrval)) None)
+                    | None ->
+                        illtyped "the value of a create_readonly didn't match the lvalue type"
+                  end
+              | _ ->
+                  illtyped "CreateReadOnly"
+            )
+      | Alloc (pe1, pe2, pref) ->
+          let fs = [pure pe1; pure pe2] in
+          fun fr k ->
+            eval_all fs fr.slots (function
+              | [Vobject (OVinteger ival1); Vobject (OVinteger ival2)] ->
+                  mem cx (Impl_mem.allocate_region cx.tid pref ival1 ival2) (fun ptrval ->
+                    k (Vobject (OVpointer ptrval)) None)
+              | _ ->
+                  illtyped "Alloc"
+            )
+      | Kill (kind, pe) ->
+          let f = pure pe in
+          fun fr k ->
+            eval f fr.slots (function
+              | Vobject (OVpointer ptrval) ->
+                  mem cx (Impl_mem.kill (mem_loc ()) (is_dynamic kind) ptrval) (fun () ->
+                    k Vunit None)
+              | _ ->
+                  illtyped "Kill"
+            )
+      | Store (_, _, _, Pexpr (_, _, PEconstrained _), _) ->
+          unsupported "store of a constrained value"
+      | Store (is_locking, pe1, pe2, pe3, _) ->
+          let fs = [pure pe1; pure pe2; pure pe3] in
+          fun fr k ->
+            eval_all fs fr.slots (function
+              | [Vctype ty; Vobject (OVpointer ptrval); cval] ->
+                  begin match Core_aux.memValueFromValue (lvalue_ty ty) cval with
+                    | Some mval ->
+                        mem cx (Impl_mem.store (mem_loc ()) ty is_locking ptrval mval) (fun fp ->
+                          k Vunit (Some fp))
+                    | None ->
+                        illtyped "the value of a store didn't match the lvalue type"
+                  end
+              | _ ->
+                  illtyped "Store"
+            )
+      | Load (pe1, pe2, _) ->
+          let fs = [pure pe1; pure pe2] in
+          fun fr k ->
+            eval_all fs fr.slots (function
+              | [Vctype ty; Vobject (OVpointer ptrval)] ->
+                  mem cx (Impl_mem.load (mem_loc ()) ty ptrval) (fun (fp, mval) ->
+                    k (snd (Core_aux.valueFromMemValue mval)) (Some fp))
+              | _ ->
+                  illtyped "Load"
+            )
+      | SeqRMW (with_forward, pe1, pe2, sym, pe3) ->
+          let fs = [pure pe1; pure pe2] in
+          let i = slot pcx.senv sym in
+          let f3 = pure pe3 in
+          fun fr k ->
+            eval_all fs fr.slots (function
+              | [Vctype ty; Vobject (OVpointer ptrval)] ->
+                  mem cx (Impl_mem.load act_loc ty ptrval) (fun (_, mval) ->
+                    fr.slots.(i) <- snd (Core_aux.valueFromMemValue mval);
+                    eval f3 fr.slots (fun cval3 ->
+                      match Core_aux.memValueFromValue (lvalue_ty ty) cval3 with
+                        | Some mval' ->
+                            mem cx (Impl_mem.store act_loc ty false ptrval mval') (fun fp ->
+                              k (snd (Core_aux.valueFromMemValue (if with_forward then mval' else mval))) (Some fp))
+                        | None ->
+                            failwith "TODO(use the error the monad) didn't match the lvalue type in SeqRMW"
+                    )
+                  )
+              | _ ->
+                  failwith "TODO(use the error the monad) illtyped SeqRMW"
+            )
+      | RMW _
+      | Fence _
+      | CompareExchangeStrong _
+      | CompareExchangeWeak _
+      | LinuxFence _
+      | LinuxLoad _
+      | LinuxStore _
+      | LinuxRMW _ ->
+          unsupported "concurrency action" in
+  let positive fr k =
+    perform fr (fun cval fp_opt ->
+      begin match fp_opt with
+        | Some fp ->
+            fr.fps <- DA_pos ([], fp) :: fr.fps;
+            fr.annotated <- true
+        | None ->
+            ()
+      end;
+      k cval
+    ) in
+  let negative what fr k =
+    let (inner, target) = negative_target fr what in
+    let n = fresh_excl cx in
+    exclude_in n fr inner;
+    perform fr (fun cval fp_opt ->
+      begin match fp_opt with
+        | Some fp -> target.pending <- DA_neg (n, [], fp) :: target.pending
+        | None -> ()
+      end;
+      fr.annotated <- true;
+      k cval
+    ) in
+  match (act, pol) with
+    | (SeqRMW _, Neg) ->
+        fun _ _ -> failwith "TODO(better typing) negative SeqRMW should be forbidden by the typecheck"
+    | (SeqRMW _, Pos) ->
+        (* the memory accesses happen before looking for the region *)
+        fun fr k ->
+          set_loc cx loc_opt;
+          perform fr (fun cval fp_opt ->
+            let (inner, target) = negative_target fr "SeqRMW" in
+            let n = fresh_excl cx in
+            exclude_in n fr inner;
+            begin match fp_opt with
+              | Some fp -> target.pending <- DA_neg (n, [], fp) :: target.pending
+              | None -> ()
+            end;
+            fr.annotated <- true;
+            k cval
+          )
+    | (_, Pos) ->
+        fun fr k ->
+          set_loc cx loc_opt;
+          positive fr k
+    | (_, Neg) ->
+        fun fr k ->
+          set_loc cx loc_opt;
+          let (inner, target) = negative_target fr "Neg" in
+          (* when the action is directly the first operand of the strong
+             sequencing, the reference makes it a positive action *)
+          if inner = [] && target.kind = Sseq_region && tail && not fr.annotated then
+            positive fr k
+          else
+            negative "Neg" fr (fun _ -> k Vunit)
+
+and compile_proc cx params (Expr (body_annots, _) as body) =
+  let senv = new_slot_env () in
+  let idxs = List.map (fun (sym, _) -> slot senv sym) params in
+  let pcx = { senv; labels= SymMap.empty; body_annots } in
+  Pmap.iter (fun label (label_params, cont) ->
+    let label_idxs = List.map (fun (sym, _) -> slot senv sym) label_params in
+    pcx.labels <- SymMap.add label (label_idxs, lazy (compile_expr cx pcx true cont)) pcx.labels
+  ) (Core_aux.collect_saves body);
+  let code = compile_expr cx pcx true body in
+  SymMap.iter (fun _ (_, cont) -> ignore (Lazy.force cont)) pcx.labels;
+  let arity = List.length idxs in
+  { arity;
+    enter= fun cvals k ->
+      let fr = { slots= Array.make senv.size Vunit; ret= k; fps= []; annotated= false; scopes= [] } in
+      List.iter2 (fun i cval -> fr.slots.(i) <- cval) idxs cvals;
+      code fr k }
+
+(* all the procedures are compiled upfront, so that calls through function
+   pointers never need to *)
+let compile (file: Core_run.core_run_annotation Core.file) =
+  let cx = {
+    file;
+    core_extern= Core_linking.create_extern_symmap file;
+    procs= SymMap.empty;
+    funs= SymMap.empty;
+    impl_funs= Hashtbl.create 16;
+    impl_defs= Hashtbl.create 16;
+    globals= SymMap.empty;
+    tid= 0;
+    loc= Cerb_location.other "Driver.drive";
+    call_loc= Cerb_location.other "Driver.drive";
+    mem_st= Impl_mem.initial_mem_state;
+    errno= Impl_mem.null_ptrval Ctype.signed_int;
+    excl_counter= 0;
+  } in
+  let add_procs decls =
+    Pmap.iter (fun sym decl ->
+      match decl with
+        | Proc (_, _, _, params, body) ->
+            cx.procs <- SymMap.add sym (lazy (compile_proc cx params body)) cx.procs
+        | Fun _ | ProcDecl _ | BuiltinDecl _ ->
+            ()
+    ) decls in
+  add_procs file.stdlib;
+  add_procs file.funs;
+  SymMap.iter (fun _ p -> ignore (Lazy.force p)) cx.procs;
+  cx
+
+(* following Driver.drive *)
+let drive file arg_strs =
+  let cx = compile file in
+  let (main_sym, main_loc, main_params, main_body) =
+    match file.main with
+      | None ->
+          unsupported "no startup function"
+      | Some main_sym ->
+          begin match Pmap.lookup main_sym file.funs with
+            | Some (Proc (loc, _, _, params, body)) ->
+                (main_sym, loc, params, body)
+            | _ ->
+                unsupported "the startup function is not a procedure"
+          end in
+  let main = Lazy.force (SymMap.find main_sym cx.procs) in
+  begin match main_params with
+    | [] | [_; _] -> ()
+    | _ -> unsupported "startup function arguments"
+  end;
+  sync cx (Driver.driver_globals false file) >>= fun tid0 ->
+  cx.tid <- tid0;
+  Driver.get_thread_states >>= begin function
+    | [(_, (_, th_st))] ->
+        SymMap.iter (fun sym r -> r := Core_aux.lookup_env sym th_st.Core_run.env) cx.globals;
+        ND.nd_return ()
+    | _ ->
+        failwith "ERROR (in Driver 1)"
+  end >>= fun () ->
+  begin match main_params with
+    | [(argc_sym, _); (argv_sym, _)] ->
+        sync cx (Driver.prepare_main_args main_loc file.calling_convention tid0 main_sym arg_strs argc_sym argv_sym) >>= fun (argc_cval, argv_cval) ->
+        ND.nd_return [argc_cval; argv_cval]
+    | _ ->
+        ND.nd_return []
+  end >>= fun args ->
+  (* allocating and initialising errno *)
+  mem cx (
+    Impl_mem.bind (Impl_mem.allocate_object tid0 (Symbol.PrefOther "errno") (Impl_mem.alignof_ival Ctype.signed_int) Ctype.signed_int None None) (fun ptrval ->
+      let zero = Impl_mem.integer_value_mval (Ctype.Signed Ctype.Int_) (Impl_mem.integer_ival Z.zero) in
+      Impl_mem.bind (Impl_mem.store (Cerb_location.other "errno init") Ctype.signed_int false ptrval zero) (fun _ ->
+        Impl_mem.return ptrval
+      )
+    )
+  ) ND.nd_return >>= fun errno ->
+  cx.errno <- errno;
+  current_thread cx >>= fun th_st ->
+  Driver.driver_update_thread_state tid0
+    { th_st with
+        Core_run.arena= main_body;
+        Core_run.stack= Core_run.Stack_empty;
+        Core_run.errno= errno;
+        Core_run.current_loc= Cerb_location.other "Driver.drive";
+        Core_run.exec_loc= Core_run.ELoc_normal [(main_sym, Cerb_location.other "Driver.drive")];
+        Core_run.current_proc_opt= Some main_sym } >>= fun () ->
+  main.enter args finish
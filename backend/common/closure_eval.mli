@@ -0,0 +1,12 @@
+open Cerb_frontend
+
+(* Raised (before anything is run) when the file uses a construct the closure
+   evaluator does not handle; the caller should then use [Driver.drive]. *)
+exception Unsupported of string
+
+(* A replacement for [Driver.drive false] on sequentialised Core, which
+   compiles every procedure once into OCaml closures instead of interpreting
+   the Core AST one reduction step at a time. It only follows one execution,
+   so it is meant for the random execution mode. *)
+val drive:
+  Core_run.core_run_annotation Core.file -> string list -> Driver.driver_result Driver.driverM
@@ -8,12 +8,18 @@ let isActive = function
   | (ND.Active _, _, _) -> true
   | _ -> false
 
+type evaluator =
+  | Reference
+  | Closures
+  | Differential
+
 type driver_conf = {
 (* TODO: bring back ==> [`Interactive | `Exhaustive | `Random] -> *)
   exec_mode: execution_mode;
   concurrency: bool;
   fs_dump: bool;
   trace: bool;
+  evaluator: evaluator;
 }
 
 type execution_result = (Core.value list, Errors.error) Exception.exceptM
@@ -148,52 +154,110 @@ let string_of_batch_output ?(json=false) ?(is_charon=false) i_opt (z3_strs, exec
   flush_all ();
   Buffer.contents buf
 
-(* TODO: make the output match the json format from charon2 (or at least add a option for that) *)
-let batch_drive (file: 'a Core.file) args fs_state conf =
-  Random.self_init ();
+let batch_output_of_execution (res, z3_strs, _) =
+  let result = begin match res with
+    | ND.Active dres ->
+        let exit =
+          match dres.Driver.dres_core_value with
+            | Vloaded (LVspecified (OVinteger ival)) ->
+                Impl_mem.case_integer_value ival
+                  (fun n  -> Specified n)
+                  (fun () -> OtherValue dres.Driver.dres_core_value)
+            | Vloaded (LVunspecified ty) ->
+                Unspecified ty
+            | _ ->
+                OtherValue dres.Driver.dres_core_value in
+        Defined { exit; stdout= dres.Driver.dres_stdout; stderr= dres.Driver.dres_stderr; blocked= dres.Driver.dres_blocked }
+    | ND.Killed (dr_st, ND.Undef0 (loc, [])) ->
+        let stderr = String.concat "" (Dlist.toList dr_st.Driver.core_state.Core_run.io.Core_run.stderr) in
+        Error { msg= "[empty UB, probably a cerberus BUG]"; stderr }
+    | ND.Killed (dr_st, ND.Undef0 (loc, ub::_)) ->
+        let stderr = String.concat "" (Dlist.toList dr_st.Driver.core_state.Core_run.io.Core_run.stderr) in
+        Undefined { ub; stderr; loc }
+    | ND.Killed (dr_st, ND.Error0 (_, msg)) ->
+        let stderr = String.concat "" (Dlist.toList dr_st.Driver.core_state.Core_run.io.Core_run.stderr) in
+        Error { msg; stderr }
+    | ND.Killed (dr_st, ND.Other dr_err) ->
+        let stderr = String.concat "" (Dlist.toList dr_st.Driver.core_state.Core_run.io.Core_run.stderr) in
+        Error { msg= string_of_driver_error dr_err; stderr }
+  end in
+  (z3_strs, result)
+
+(* the closure evaluator only follows one execution of sequential programs,
+   and only some of Core *)
+let closure_drive conf file args =
+  if conf.concurrency || conf.exec_mode <> Random then
+    None
+  else match Closure_eval.drive file args with
+    | m ->
+        Some m
+    | exception (Closure_eval.Unsupported str) ->
+        Cerb_debug.print_debug 1 [] (fun () ->
+          "the closure evaluator does not support " ^ str ^ ", using the reference driver"
+        );
+        None
+
+let show_executions values =
+  List.map (fun exec -> string_of_batch_output None (batch_output_of_execution exec)) values
+  |> String.concat ""
+  |> String.trim
+
+(* returns the executions of the reference driver, or of the closure evaluator
+   if it was selected, and with the differential mode, a mismatch between the
+   two evaluators *)
+let run_drivers (file: 'a Core.file) args fs_state conf =
   (* changing the annotations type from unit to core_run_annotation *)
   let file = Core_run_aux.convert_file file in
   (* computing the value (or values if exhaustive) *)
   let initial_dr_st = Driver.initial_driver_state file fs_state in
-  let values = Smt2.runND conf.exec_mode Impl_mem.cs_module (Driver.drive conf.concurrency file args) initial_dr_st in
-  List.mapi (fun i (res, z3_strs, nd_st) ->
-    let result = begin match res with
-      | ND.Active dres ->
-          let exit =
-            match dres.Driver.dres_core_value with
-              | Vloaded (LVspecified (OVinteger ival)) ->
-                  Impl_mem.case_integer_value ival
-                    (fun n  -> Specified n)
-                    (fun () -> OtherValue dres.Driver.dres_core_value)
-              | Vloaded (LVunspecified ty) ->
-                  Unspecified ty
-              | _ ->
-                  OtherValue dres.Driver.dres_core_value in
-          Defined { exit; stdout= dres.Driver.dres_stdout; stderr= dres.Driver.dres_stderr; blocked= dres.Driver.dres_blocked }
-      | ND.Killed (dr_st, ND.Undef0 (loc, [])) ->
-          let stderr = String.concat "" (Dlist.toList dr_st.Driver.core_state.Core_run.io.Core_run.stderr) in
-          Error { msg= "[empty UB, probably a cerberus BUG]"; stderr }
-      | ND.Killed (dr_st, ND.Undef0 (loc, ub::_)) ->
-          let stderr = String.concat "" (Dlist.toList dr_st.Driver.core_state.Core_run.io.Core_run.stderr) in
-          Undefined { ub; stderr; loc }
-      | ND.Killed (dr_st, ND.Error0 (_, msg)) ->
-          let stderr = String.concat "" (Dlist.toList dr_st.Driver.core_state.Core_run.io.Core_run.stderr) in
-          Error { msg; stderr }
-      | ND.Killed (dr_st, ND.Other dr_err) ->
-          let stderr = String.concat "" (Dlist.toList dr_st.Driver.core_state.Core_run.io.Core_run.stderr) in
-          Error { msg= string_of_driver_error dr_err; stderr }
-    end in
-    (z3_strs, result)
-  ) values
+  let run exec_mode m = Smt2.runND exec_mode Impl_mem.cs_module m initial_dr_st in
+  let reference exec_mode = run exec_mode (Driver.drive conf.concurrency file args) in
+  match conf.evaluator with
+    | Reference ->
+        (reference conf.exec_mode, None)
+    | Closures ->
+        begin match closure_drive conf file args with
+          | Some m -> (run conf.exec_mode m, None)
+          | None -> (reference conf.exec_mode, None)
+        end
+    | Differential ->
+        let values = reference conf.exec_mode in
+        let mismatch = match closure_drive conf file args with
+          | None ->
+              None
+          | Some m ->
+              let closure_str = show_executions (run conf.exec_mode m) in
+              (* the random reference execution may have picked other orders
+                 for unsequenced operations than the closure evaluator (which
+                 goes left to right), so on a difference, the closure
+                 execution is checked against all the reference ones *)
+              let allowed () =
+                List.exists (fun exec -> show_executions [exec] = closure_str)
+                  (reference Exhaustive) in
+              if show_executions values = closure_str || allowed () then
+                None
+              else
+                Some ("evaluator mismatch, closure evaluator gave: " ^ closure_str) in
+        (values, mismatch)
+
+(* TODO: make the output match the json format from charon2 (or at least add a option for that) *)
+let batch_drive (file: 'a Core.file) args fs_state conf =
+  Random.self_init ();
+  match run_drivers file args fs_state conf with
+    | (values, None) ->
+        List.map batch_output_of_execution values
+    | (_, Some msg) ->
+        [([], Error { msg; stderr= "" })]
 
 let drive file args fs_state conf : execution_result =
   Random.self_init ();
-  (* changing the annotations type from unit to core_run_annotation *)
-  let file = Core_run_aux.convert_file file in
-  (* computing the value (or values if exhaustive) *)
-  let initial_dr_st = Driver.initial_driver_state file fs_state in
-  let values = Smt2.runND conf.exec_mode Impl_mem.cs_module
-      (Driver.drive conf.concurrency file args) initial_dr_st in
+  let (values, mismatch) = run_drivers file args fs_state conf in
+  begin match mismatch with
+    | Some msg ->
+        prerr_endline Cerb_colour.(ansi_format [Red] ("WARNING: " ^ msg))
+    | None ->
+        ()
+  end;
   let n_actives = List.length (List.filter isActive values) in
   let n_execs   = List.length values                        in
   Cerb_debug.print_debug 2 [] (fun () ->
@@ -1,11 +1,20 @@
 open Cerb_frontend
 
+(* [Closures] uses the closure evaluator (Closure_eval) where it applies,
+   [Differential] also runs it and reports when its execution is not one of
+   those of the reference driver *)
+type evaluator =
+  | Reference
+  | Closures
+  | Differential
+
 type driver_conf = {
 (* TODO: bring back ==> [`Interactive | `Exhaustive | `Random] -> *)
   exec_mode: Cerb_global.execution_mode;
   concurrency: bool;
   fs_dump: bool;
   trace: bool;
+  evaluator: evaluator;
 }
 
 type execution_result = (Core.value list, Errors.error) Exception.exceptM
@@ -121,7 +121,10 @@ let (default_io_helpers, get_progress) =
       end;
   }, fun () -> !progress
 
-let cpp (conf, io) ~filename =
+(* Runs the C preprocessor on [filename], passing its output channel to
+   [consume] while it runs. Whatever [consume] leaves unread is drained, so
+   that cpp can exit. *)
+let with_cpp (conf, io) ~filename consume =
   io.print_debug 5 (fun () -> "C prepocessor") >>= fun () ->
   Unix.handle_unix_error begin fun () ->
     let (out_read, out_write) = Unix.pipe () in
@@ -147,7 +150,13 @@ let cpp (conf, io) ~filename =
       with End_of_file -> List.rev acc
     in
     flush_all ();
-    let out = read [] out_ic in
+    let result = consume out_ic in
+    let rec drain ic =
+      match input_line ic with
+      | _ -> drain ic
+      | exception End_of_file -> ()
+    in
+    drain out_ic;
     close_in out_ic;
     let err = match err_ic_opt with
       | Some err_ic ->
@@ -163,13 +172,24 @@ let cpp (conf, io) ~filename =
       if n <> 0 then
         Exception.fail (Cerb_location.unknown, Errors.CPP (String.concat "\n" err))
       else
-        return @@ String.concat "\n" out
+        result
   end ()
 
+let cpp (conf, io) ~filename =
+  with_cpp (conf, io) ~filename begin fun out_ic ->
+    let rec read acc =
+      match input_line out_ic with
+      | line -> read (line :: acc)
+      | exception End_of_file -> List.rev acc
+    in
+    return @@ String.concat "\n" (read [])
+  end
+
 let c_frontend ?(cn_init_scope=Cn_desugaring.empty_init) (conf, io) (core_stdlib, core_impl) ~filename =
   Cerb_fresh.set_digest filename;
-  let parse filename file_content =
-    C_parser_driver.parse_from_string ~filename file_content >>= fun cabs_tunit ->
+  let parse filename =
+    (* the parser consumes the output of cpp as it is produced *)
+    with_cpp (conf, io) ~filename (C_parser_driver.parse_channel ~filename) >>= fun cabs_tunit ->
     io.set_progress "CPARS" >>= fun () ->
     io.pass_message "C parsing completed!" >>= fun () ->
     whenM (List.mem Cabs conf.astprints) begin
@@ -227,11 +247,11 @@ let c_frontend ?(cn_init_scope=Cn_desugaring.empty_init) (conf, io) (core_stdlib
         io.run_pp fout_opt doc
     end >>= fun () -> return ailtau_prog in
   (* -- *)
+  let timed name f x = Cerb_metrics.time_phase name (fun () -> f x) in
   io.print_debug 2 (fun () -> "Using the C frontend") >>= fun () ->
-  cpp (conf, io) ~filename    >>= fun file_content            ->
-  parse filename file_content >>= fun cabs_tunit              ->
-  desugar cabs_tunit          >>= fun (markers_env, ail_prog) ->
-  ail_typechecking ail_prog   >>= fun ailtau_prog             ->
+  timed "parse" parse filename              >>= fun cabs_tunit              ->
+  timed "desugar" desugar cabs_tunit        >>= fun (markers_env, ail_prog) ->
+  timed "typing" ail_typechecking ail_prog  >>= fun ailtau_prog             ->
   return (cabs_tunit, (markers_env, ailtau_prog))
 
 let c_frontend_and_elaboration ?(cn_init_scope=Cn_desugaring.empty_init) (conf, io) (core_stdlib, core_impl) ~filename =
@@ -242,7 +262,10 @@ let c_frontend_and_elaboration ?(cn_init_scope=Cn_desugaring.empty_init) (conf,
   Tags.reset_tagDefs ();
   let calling_convention =
     Core.(if Switches.has_switch SW_inner_arg_temps then Inner_arg_callconv else Normal_callconv) in
-  let core_file = Translation.translate core_stdlib calling_convention core_impl ailtau_prog in
+  let core_file =
+    Cerb_metrics.time_phase "elaboration" begin fun () ->
+      Translation.translate core_stdlib calling_convention core_impl ailtau_prog
+    end in
   io.set_progress "ELABO" >>= fun () ->
   io.pass_message "Translation to Core completed!" >>= fun () ->
   return (Some cabs_tunit, Some (markers_env, ailtau_prog), core_file)
@@ -613,8 +636,8 @@ type 'a core_dump =
   }
 
 let sym_compare (Symbol.Symbol (d1, n1, _)) (Symbol.Symbol (d2, n2, _)) =
-  if d1 = d2 then compare n1 n2
-  else Digest.compare d1 d2
+  if Int.equal d1 d2 then Int.compare n1 n2
+  else Int.compare d1 d2
 
 let cabsid_compare (Symbol.Identifier (_, s1)) (Symbol.Identifier (_, s2)) =
   String.compare s1 s2
@@ -28,7 +28,7 @@ let frontend (conf, io) ~is_lib filename core_std =
     read_core_object (conf, io) ~is_lib core_std filename
   else if Filename.check_suffix filename ".c" then
     c_frontend_and_elaboration (conf, io) core_std ~filename >>= fun (_, _, core_file) ->
-    core_passes (conf, io) ~filename core_file
+    Cerb_metrics.time_phase "core_passes" (fun () -> core_passes (conf, io) ~filename core_file)
   else if Filename.check_suffix filename ".core" then
     core_frontend (conf, io) core_std ~filename
     >>= core_passes (conf, io) ~filename
@@ -99,10 +99,18 @@ let cerberus debug_level progress core_obj
              exec exec_mode iso_switches switches batch concurrency
              astprints pprints ppflags pp_ail_out pp_core_out
              sequentialise_core rewrite_core typecheck_core defacto permissive ignore_bitfields
-             fs_dump fs trace
+             fs_dump fs trace evaluator
+             bench_metrics
              output_name
              files args_opt =
   Cerb_debug.debug_level := debug_level;
+  begin match bench_metrics with
+    | Some file ->
+        Cerb_metrics.enabled := true;
+        at_exit (fun () -> Cerb_metrics.output_file file)
+    | None ->
+        ()
+  end;
   begin if is_cheri_memory () then
     Cerb_runtime.set_package "cerberus-cheri"
   end;
@@ -268,14 +276,17 @@ let cerberus debug_level progress core_obj
         prelude >>= main >>= begin function
           | [] -> assert false
           | f::fs ->
-            Core_linking.link (f::fs)
+            Cerb_metrics.time_phase "linking" (fun () -> Core_linking.link (f::fs))
         end >>= fun core_file ->
         if exec then
           let open Driver_ocaml in
           let () = Tags.reset_tagDefs () in (* TODO: check this *)
           let () = Tags.set_tagDefs core_file.tagDefs in
-          let driver_conf = {concurrency; exec_mode; fs_dump; trace} in
-          interp_backend io core_file ~args ~batch ~fs ~driver_conf
+          let core_file = Core_resolve.rewrite_file core_file in
+          let driver_conf = {concurrency; exec_mode; fs_dump; trace; evaluator} in
+          Cerb_metrics.time_phase "execution" begin fun () ->
+            interp_backend io core_file ~args ~batch ~fs ~driver_conf
+          end
         else
           match output_name with
           | None ->
@@ -488,6 +499,20 @@ let trace =
   let doc = "trace memory actions" in
   Arg.(value & flag & info["trace"] ~doc)
 
+let evaluator =
+  let doc = "Set the Core evaluator used by --exec (reference | closure | differential). \
+             The closure evaluator compiles the Core program to OCaml closures, it is \
+             only used in the random mode without concurrency (and otherwise falls back to \
+             the reference). The differential mode runs both and reports any mismatch." in
+  Arg.(value & opt (enum ["reference", Driver_ocaml.Reference;
+                          "closure", Driver_ocaml.Closures;
+                          "differential", Driver_ocaml.Differential])
+         Driver_ocaml.Reference & info ["evaluator"] ~docv:"EVALUATOR" ~doc)
+
+let bench_metrics =
+  let doc = "write per-phase benchmark metrics (timings and allocations) as JSON to $(docv)" in
+  Arg.(value & opt (some string) None & info ["bench-metrics"] ~docv:"FILE" ~doc)
+
 let switches =
   let doc = "list of semantics switches to turn on (see documentation for the list)" in
   Arg.(value & opt (list string) [] & info ["switches"] ~docv:"SWITCH1,..." ~doc)
@@ -511,7 +536,8 @@ let () =
                          concurrency $
                          astprints $ pprints $ ppflags $ pp_ail_out $ pp_core_out $
                          sequentialise $ rewrite $ typecheck_core $ defacto $ permissive $ ignore_bitfields $
-                         fs_dump $ fs $ trace $
+                         fs_dump $ fs $ trace $ evaluator $
+                         bench_metrics $
                          output_file $
                          files $ args) in
   let version = Version.version in
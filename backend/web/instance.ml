@@ -78,7 +78,7 @@ let hack ?(is_bmc=false) ~conf mode =
       ignore_bitfields= false;
       n1570=            Some conf.instance.n1570;
     }
-  in cerb_conf := fun () -> conf
+  in set_conf conf
 
 let respond filename name f = function
   | Exception.Result r ->
@@ -223,7 +223,7 @@ let execute ~conf ~filename (mode: Cerb_global.execution_mode) =
     end >>= fun core ->
     Tags.set_tagDefs core.tagDefs;
     let open Driver_ocaml in
-    let driver_conf = {concurrency=false; exec_mode=mode; fs_dump=false; trace=false; } in
+    let driver_conf = {concurrency=false; exec_mode=mode; fs_dump=false; trace=false; evaluator=Reference; } in
     interp_backend dummy_io core ~args:[] ~batch:`Batch ~fs:None ~driver_conf
     >>= function
     | Either.Left (_, execs) ->
@@ -648,9 +648,13 @@ let step ~conf ~filename (active_node_opt: Instance_api.active_node option) =
     hack ~conf Random;
     Switches.set conf.instance.switches;
     last_node_id := n.last_id;
-    decode n.marshalled_state
-    |> multiple_steps ([], [], n.active_id)
-    |> fun (res, (ns, es, _)) -> return @@ Step (res, n.active_id, (ns, es))
+    let (m, st) = decode n.marshalled_state in
+    (* the client already has the memory of the active node *)
+    let active_memory =
+      Impl_mem.serialise_mem_state (get_file_hash st.Driver.core_file) st.Driver.layout_state in
+    multiple_steps ([], [], n.active_id) (m, st)
+    |> fun (res, (ns, es, _)) ->
+    return @@ Step (res, n.active_id, delta_encode_memory n.active_id active_memory (ns, es))
 
 let instance debug_level =
   Debug.level := debug_level;
@@ -83,6 +83,53 @@ type edge =
  * than functional AST for trees *)
 type exec_tree = node list * edge list
 
+(* NOTE: when stepping, only the new nodes and edges are sent to the client,
+ * and the memory of each node is replaced by its difference with the memory
+ * of its parent. Memory states are JSON objects whose fields are either maps
+ * keyed by allocation id or plain values: for the former only the changed and
+ * removed allocations are kept. *)
+let diff_memory ~parent_id (parent: Cerb_json.json) (mem: Cerb_json.json) : Cerb_json.json =
+  match parent, mem with
+  | `Assoc pfields, `Assoc fields ->
+    let diff_field (k, v) =
+      match List.assoc_opt k pfields, v with
+      | Some (`Assoc pmap), `Assoc map ->
+        let ptbl = Hashtbl.create (List.length pmap) in
+        List.iter (fun (id, alloc) -> Hashtbl.replace ptbl id alloc) pmap;
+        let tbl = Hashtbl.create (List.length map) in
+        List.iter (fun (id, _) -> Hashtbl.replace tbl id ()) map;
+        let changed = List.filter (fun (id, alloc) ->
+            Hashtbl.find_opt ptbl id <> Some alloc
+          ) map in
+        let removed = List.filter_map (fun (id, _) ->
+            if Hashtbl.mem tbl id then None else Some (`String id)
+          ) pmap in
+        (k, `Assoc [("changed", `Assoc changed); ("removed", `List removed)])
+      | _ ->
+        (k, `Assoc [("value", v)])
+    in
+    `Assoc [("delta", `Int parent_id);
+            ("fields", `Assoc (List.map diff_field fields))]
+  | _ ->
+    mem
+
+(* [root_mem] is the memory of the node [root_id], from which the tree grows *)
+let delta_encode_memory root_id root_mem ((ns, es): exec_tree) : exec_tree =
+  let parents = Hashtbl.create (List.length es) in
+  List.iter (function Edge (p, c) -> Hashtbl.replace parents c p) es;
+  let mems = Hashtbl.create (List.length ns + 1) in
+  Hashtbl.replace mems root_id root_mem;
+  List.iter (fun n -> Hashtbl.replace mems n.node_id n.memory) ns;
+  let encode n =
+    match Option.bind (Hashtbl.find_opt parents n.node_id) (fun p ->
+        Option.map (fun mem -> (p, mem)) (Hashtbl.find_opt mems p)) with
+    | Some (parent_id, parent) ->
+      { n with memory = diff_memory ~parent_id parent n.memory }
+    | None ->
+      n
+  in
+  (List.map encode ns, es)
+
 type ast_result =
   { cabs: string option;
     ail:  string option;
@@ -17,6 +17,8 @@ type webconf =
     z3_path: string;
     cerb_debug_level: int;
     tmp_path: string;
+    gzip_level: int;          (* 0 disables the compression of JSON responses *)
+    gzip_detach_size: int;    (* larger JSON responses are compressed off the event loop *)
   }
 
 let webconf =
@@ -50,7 +52,8 @@ let print_webconf () =
     CERB_PATH: %s
     Core implementation file: %s
     Z3 path: %s
-    TMP path: %s\n"
+    TMP path: %s
+    Compression level: %d (off the event loop above %d bytes)\n"
     w.tcp_port
     w.docroot
     w.timeout
@@ -60,7 +63,9 @@ let print_webconf () =
     w.cerb_path
     w.core_impl
     w.z3_path
-    w.tmp_path;
+    w.tmp_path
+    w.gzip_level
+    w.gzip_detach_size;
   flush stdout
 
 let set_webconf cfg_file timeout core_impl tcp_port docroot cerb_debug_level =
@@ -92,6 +97,8 @@ let set_webconf cfg_file timeout core_impl tcp_port docroot cerb_debug_level =
       z3_path= ld_path;
       tmp_path= Filename.get_temp_dir_name ();
       cerb_debug_level= 0;
+      gzip_level= 6;
+      gzip_detach_size= 65536;
     }
   in
   let parse cfg = function
@@ -118,6 +125,15 @@ let set_webconf cfg_file timeout core_impl tcp_port docroot cerb_debug_level =
     | ("z3_path", `String path) -> { cfg with z3_path = path }
     | ("cerb_path", `String path) -> { cfg with cerb_path= path }
     | ("tmp_path", `String path) -> { cfg with tmp_path= path }
+    | ("compression", `Assoc compression) ->
+      let parse_compression cfg = function
+        | ("level", `Int n) when 0 <= n && n <= 9 -> { cfg with gzip_level = n }
+        | ("detach_size", `Int n) -> { cfg with gzip_detach_size = n }
+        | (k, _) ->
+          Debug.warn @@ "Unknown compression configuration key: " ^ k;
+          cfg
+      in
+      List.fold_left parse_compression cfg compression
     | (k, _) ->
       Debug.warn @@ "Unknown configuration key: " ^ k;
       cfg
@@ -485,9 +501,20 @@ let resolve_mime file =
   | ".ico" -> "image/x-icon"
   | _ -> "text/plain"
 
+(* Compressing a large execution graph takes long enough to stall every other
+   connection, so it is done in a separate thread. *)
+let compress_json str =
+  let w = !webconf() in
+  let compress () = Ezgzip.compress ~level:w.gzip_level str in
+  if String.length str > w.gzip_detach_size then
+    Lwt_preemptive.detach compress ()
+  else
+    return @@ compress ()
+
 let respond_json ~time ~rheader json =
-  let gzipped  = rheader.accept_gzip in
-  let compress = (if gzipped then Ezgzip.compress ~level:9 else id) in
+  let gzipped = rheader.accept_gzip && (!webconf()).gzip_level > 0 in
+  let str = Yojson.to_string json in
+  (if gzipped then compress_json str else return str) >>= fun body ->
   let headers = Cohttp.Header.of_list
       [("Content-Type", "text/json; charset=utf-8");
        ("Content-Encoding", if gzipped then "gzip" else "identity");
@@ -495,7 +522,6 @@ let respond_json ~time ~rheader json =
        ("Server-Timing",
         match time with Some t -> "dur=" ^ string_of_float t | None -> "");
        ("Server", "Cerberus/1.0")] in
-  let body = compress @@ Yojson.to_string json in
   Server.respond_string ~flush:true ~headers ~status:`OK ~body ()
 
 let date () =
@@ -514,19 +540,55 @@ let date () =
     (week tm.tm_wday) tm.tm_mday (month tm.tm_mon) (tm.tm_year+1900)
     (tm.tm_hour+1) tm.tm_min tm.tm_sec
 
+(* ETags of the static files, keyed by path. An entry is reused for as long as
+   the modification time and size of the file are unchanged, so that files are
+   only hashed (off the event loop) when first served or after being updated. *)
+let etags : (string, (float * int * string)) Hashtbl.t =
+  Hashtbl.create 64
+
+let etag_of_file fname =
+  Lwt_unix.stat fname >>= fun st ->
+  let key = (st.Unix.st_mtime, st.Unix.st_size) in
+  match Hashtbl.find_opt etags fname with
+  | Some (mtime, size, hash) when (mtime, size) = key ->
+    return hash
+  | _ ->
+    Lwt_preemptive.detach (fun () -> Digest.to_hex @@ Digest.file fname) () >|= fun hash ->
+    Hashtbl.replace etags fname (fst key, snd key, hash);
+    hash
+
+(* Hash every file of the public folder at startup. *)
+let precompute_etags docroot =
+  let rec walk dir =
+    Lwt_unix.files_of_directory dir
+    |> Lwt_stream.iter_s begin fun entry ->
+      if entry = "." || entry = ".." then
+        return_unit
+      else
+        let path = Filename.concat dir entry in
+        Lwt_unix.lstat path >>= fun st ->
+        match st.Unix.st_kind with
+        | Unix.S_DIR -> walk path
+        | Unix.S_REG -> etag_of_file path >|= ignore
+        | _ -> return_unit
+    end
+  in
+  Lwt.catch (fun () -> walk docroot) begin fun e ->
+    Debug.error_exception "Error hashing the public folder:" e;
+    return_unit
+  end
+
 let respond_file ~rheader fname =
   (* I know this is already done before calls to this function.
      Tryin to prevent future misuses. *)
   if not (check_filepath fname) then begin
     forbidden fname
   end else begin
-    let gzipped = rheader.accept_gzip && Sys.file_exists (fname ^ ".gz") in
+    (if rheader.accept_gzip then Lwt_unix.file_exists (fname ^ ".gz") else return_false)
+    >>= fun gzipped ->
     let mime  = resolve_mime fname in
     let fname = fname ^ (if gzipped then ".gz" else "") in
-    let hash = Digest.to_hex @@ Digest.file fname in
-    Debug.print 7 @@ "File: " ^ fname;
-    Debug.print 7 @@ "Hash: " ^ hash;
-    let try_with () =
+    let try_with hash () =
       let count = 16384 (* 16 KB *) in
       Lwt_io.open_file
         ~buffer:(Lwt_bytes.create count)
@@ -557,11 +619,17 @@ let respond_file ~rheader fname =
       let res = Cohttp.Response.make ~status:`OK ~encoding ~headers () in
       return (res, body)
     in
-    if rheader.if_none_match = hash then begin
-      Debug.warn "not-modified";
-      Server.respond ~status:`Not_modified ~body:`Empty ()
-    end
-    else Lwt.catch try_with @@ function
+    let respond () =
+      etag_of_file fname >>= fun hash ->
+      Debug.print 7 @@ "File: " ^ fname;
+      Debug.print 7 @@ "Hash: " ^ hash;
+      if rheader.if_none_match = hash then begin
+        Debug.warn "not-modified";
+        Server.respond ~status:`Not_modified ~body:`Empty ()
+      end
+      else try_with hash ()
+    in
+    Lwt.catch respond @@ function
       | Unix.Unix_error (Unix.ENOENT, _, _) ->
         Server.respond_not_found ()
       | e ->
@@ -577,31 +645,51 @@ let now () =
     tm.tm_mday (tm.tm_mon+1) (tm.tm_year+1900)
     (tm.tm_hour+1) tm.tm_min tm.tm_sec
 
+(* The log files are opened once, and written through buffered Lwt channels
+   (which are flushed when the event loop is idle), so that logging a request
+   never blocks the server. *)
+let log_channels : (string, Lwt_io.output_channel Lwt.t) Hashtbl.t =
+  Hashtbl.create 2
+
+let log_channel file =
+  match Hashtbl.find_opt log_channels file with
+  | Some oc -> oc
+  | None ->
+    let oc = Lwt_io.open_file ~mode:Lwt_io.output
+        ~flags:Unix.[O_WRONLY; O_APPEND; O_CREAT] ~perm:0o666 file in
+    Hashtbl.replace log_channels file oc;
+    oc
+
+let log file line =
+  Lwt.async begin fun () ->
+    Lwt.catch (fun () ->
+        log_channel file >>= fun oc ->
+        Lwt_io.write_line oc line)
+      (fun e ->
+        Debug.error_exception ("Error writing to log " ^ file) e;
+        Hashtbl.remove log_channels file;
+        return_unit)
+  end
+
 let log_index flow =
   match Conduit_lwt_unix.endp_of_flow flow with
   | `TLS (_, `TCP (ip, _))
   | `TCP (ip, _) ->
-    let oc =
-      open_out_gen [Open_text;Open_append;Open_creat] 0o666 (!webconf()).index_file
-    in
-    Printf.fprintf oc "%s %s\n" (Ipaddr.to_string ip) (now ());
-    close_out oc
+    log (!webconf()).index_file
+      (Printf.sprintf "%s %s" (Ipaddr.to_string ip) (now ()))
   | _ -> ()
 
 let log_request msg flow =
   match Conduit_lwt_unix.endp_of_flow flow with
   | `TLS (_, `TCP (ip, _))
   | `TCP (ip, _) ->
-    let oc = open_out_gen [Open_text;Open_append;Open_creat] 0o666
-        (!webconf()).request_file
-    in
-    Printf.fprintf oc "%s %s %s:%s \"%s\"\n"
-      (Ipaddr.to_string ip)
-      (now ())
-      (string_of_action msg.action)
-      (string_of_model msg.model)
-      (String.escaped msg.source);
-    close_out oc
+    log (!webconf()).request_file
+      (Printf.sprintf "%s %s %s:%s \"%s\""
+         (Ipaddr.to_string ip)
+         (now ())
+         (string_of_action msg.action)
+         (string_of_model msg.model)
+         (String.escaped msg.source))
   | _ -> ()
 
 let shorten source =
@@ -838,7 +926,8 @@ let initialise () =
     let http_server = Server.make
         ~callback: (request ~conf) () in
     Lwt_main.run @@ Lwt.join
-      [ Server.create ~mode:(`TCP (`Port webconf.tcp_port)) http_server ]
+      [ precompute_etags webconf.docroot
+      ; Server.create ~mode:(`TCP (`Port webconf.tcp_port)) http_server ]
   with
   | e ->
     Debug.error_exception "Fatal error:" e
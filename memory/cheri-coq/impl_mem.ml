@@ -14,30 +14,35 @@ open AMap
 
 module CerbSwitchesProxy = struct
 
-  let toCoq_switch: Switches.cerb_switch -> CoqSwitches.cerb_switch = function
-    | SW_pointer_arith `PERMISSIVE -> CoqSwitches.SW_pointer_arith CoqSwitches.PERMISSIVE
-    | SW_pointer_arith `STRICT -> CoqSwitches.SW_pointer_arith CoqSwitches.STRICT
-    | SW_strict_reads -> SW_strict_reads
-    | SW_forbid_nullptr_free -> SW_forbid_nullptr_free
-    | SW_zap_dead_pointers -> SW_zap_dead_pointers
-    | SW_strict_pointer_equality -> SW_strict_pointer_equality
-    | SW_strict_pointer_relationals -> SW_strict_pointer_relationals
-    | SW_PNVI `PLAIN -> SW_PNVI PLAIN
-    | SW_PNVI `AE -> SW_PNVI AE
-    | SW_PNVI `AE_UDI -> SW_PNVI AE_UDI
-    | SW_CHERI -> SW_CHERI
-    | SW_inner_arg_temps -> SW_inner_arg_temps
-    | SW_permissive_printf -> SW_permissive_printf
-    | SW_zero_initialised -> SW_zero_initialised
-    | SW_revocation `INSTANT -> SW_revocation INSTANT
-    | SW_revocation `CORNUCOPIA -> SW_revocation CORNUCOPIA
-    | SW_at_magic_comments -> SW_at_magic_comments
-    | SW_magic_comment_char_dollar -> SW_magic_comment_char_dollar
+  (* the switches only affecting the elaboration have no counterpart in the Coq model *)
+  let toCoq_switch: Switches.cerb_switch -> CoqSwitches.cerb_switch option = function
+    | SW_pointer_arith `PERMISSIVE -> Some (CoqSwitches.SW_pointer_arith CoqSwitches.PERMISSIVE)
+    | SW_pointer_arith `STRICT -> Some (CoqSwitches.SW_pointer_arith CoqSwitches.STRICT)
+    | SW_strict_reads -> Some SW_strict_reads
+    | SW_forbid_nullptr_free -> Some SW_forbid_nullptr_free
+    | SW_zap_dead_pointers -> Some SW_zap_dead_pointers
+    | SW_strict_pointer_equality -> Some SW_strict_pointer_equality
+    | SW_strict_pointer_relationals -> Some SW_strict_pointer_relationals
+    | SW_PNVI `PLAIN -> Some (SW_PNVI PLAIN)
+    | SW_PNVI `AE -> Some (SW_PNVI AE)
+    | SW_PNVI `AE_UDI -> Some (SW_PNVI AE_UDI)
+    | SW_CHERI -> Some SW_CHERI
+    | SW_inner_arg_temps -> Some SW_inner_arg_temps
+    | SW_permissive_printf -> Some SW_permissive_printf
+    | SW_zero_initialised -> Some SW_zero_initialised
+    | SW_revocation `INSTANT -> Some (SW_revocation INSTANT)
+    | SW_revocation `CORNUCOPIA -> Some (SW_revocation CORNUCOPIA)
+    | SW_at_magic_comments -> Some SW_at_magic_comments
+    | SW_magic_comment_char_dollar -> Some SW_magic_comment_char_dollar
+    | SW_elide_range_checks -> None
 
   let toCoq_switches (cs: cerb_switch list): CoqSwitches.cerb_switches_t =
     let open ListSet in
     List.fold_left
-      (fun s x -> set_add (=) (toCoq_switch x) s) empty_set cs
+      (fun s x ->
+        match toCoq_switch x with
+        | Some x' -> set_add (=) x' s
+        | None -> s) empty_set cs
 
   let get_switches _ = toCoq_switches (Switches.get_switches ())
 end
@@ -79,15 +84,19 @@ module CerbTagDefs = struct
     | SD_FunArgValue s -> SD_FunArgValue s
     | SD_FunArg (l,v) -> SD_FunArg (toCoq_location l, Z.of_int v)
 
+  (* CoqSymbol.digest is a string: the fixed-width hex form of the digest,
+     which is ordered as the digests are *)
+  let toCoq_digest: Symbol.digest -> CoqSymbol.digest = Cerb_fresh.string_of_digest
+
   let toCoq_Symbol_sym: Symbol.sym -> CoqSymbol.sym = function
-    | Symbol (d,v,desc) -> Symbol (d, Z.of_int v, toCoq_Symbol_description desc)
+    | Symbol (d,v,desc) -> Symbol (toCoq_digest d, Z.of_int v, toCoq_Symbol_description desc)
 
   let toCoq_Symbol_prefix: Symbol.prefix -> CoqSymbol.prefix = function
     | PrefSource (loc, sl) -> PrefSource (toCoq_location loc, List.map toCoq_Symbol_sym sl)
-    | PrefFunArg (l, d, v) -> PrefFunArg (toCoq_location l, d, Z.of_int v)
-    | PrefStringLiteral (l,d) -> PrefStringLiteral (toCoq_location l, d)
-    | PrefTemporaryLifetime (l,d) -> PrefTemporaryLifetime (toCoq_location l, d)
-    | PrefCompoundLiteral (l,d) ->  PrefCompoundLiteral (toCoq_location l, d)
+    | PrefFunArg (l, d, v) -> PrefFunArg (toCoq_location l, toCoq_digest d, Z.of_int v)
+    | PrefStringLiteral (l,d) -> PrefStringLiteral (toCoq_location l, toCoq_digest d)
+    | PrefTemporaryLifetime (l,d) -> PrefTemporaryLifetime (toCoq_location l, toCoq_digest d)
+    | PrefCompoundLiteral (l,d) ->  PrefCompoundLiteral (toCoq_location l, toCoq_digest d)
     | PrefMalloc -> PrefMalloc
     | PrefOther s -> PrefOther s
 
@@ -673,15 +682,17 @@ module CHERIMorello : Memory = struct
     | SD_FunArgValue s -> SD_FunArgValue s
     | SD_FunArg (l,v) -> SD_FunArg (fromCoq_location l, Z.to_int v)
 
+  let fromCoq_digest: CoqSymbol.digest -> Symbol.digest = Cerb_fresh.digest_of_string
+
   let fromCoq_Symbol_sym: CoqSymbol.sym -> Symbol.sym = function
-    | Symbol (d,v,desc) -> Symbol (d,Z.to_int v, fromCoq_Symbol_description desc)
+    | Symbol (d,v,desc) -> Symbol (fromCoq_digest d, Z.to_int v, fromCoq_Symbol_description desc)
 
   let fromCoq_Symbol_prefix: CoqSymbol.prefix -> Symbol.prefix = function
     | PrefSource (loc, sl) -> PrefSource (fromCoq_location loc, List.map fromCoq_Symbol_sym sl)
-    | PrefFunArg (l, d, v) -> PrefFunArg (fromCoq_location l, d, Z.to_int v)
-    | PrefStringLiteral (l,d) -> PrefStringLiteral (fromCoq_location l, d)
-    | PrefTemporaryLifetime (l, d) -> PrefTemporaryLifetime (fromCoq_location l, d)
-    | PrefCompoundLiteral (l,d) ->  PrefCompoundLiteral (fromCoq_location l, d)
+    | PrefFunArg (l, d, v) -> PrefFunArg (fromCoq_location l, fromCoq_digest d, Z.to_int v)
+    | PrefStringLiteral (l,d) -> PrefStringLiteral (fromCoq_location l, fromCoq_digest d)
+    | PrefTemporaryLifetime (l, d) -> PrefTemporaryLifetime (fromCoq_location l, fromCoq_digest d)
+    | PrefCompoundLiteral (l,d) ->  PrefCompoundLiteral (fromCoq_location l, fromCoq_digest d)
     | PrefMalloc -> PrefMalloc
     | PrefOther s -> PrefOther s
 
@@ -479,7 +479,7 @@ module Concrete : Memory = struct
     allocations: allocation IntMap.t;
     (* this is only for PNVI-ae-udi *)
     iota_map: [ `Single of storage_instance_id | `Double of storage_instance_id * storage_instance_id ] IntMap.t;
-    funptrmap: (Digest.t * string) IntMap.t;
+    funptrmap: (Symbol.digest * string) IntMap.t;
     varargs: (int * (ctype * pointer_value) list) IntMap.t;
     next_varargs_id: N.num;
     bytemap: AbsByte.t IntMap.t;
@@ -1116,7 +1116,7 @@ module Concrete : Memory = struct
       )
   
   (* INTERNAL repr *)
-  let rec repr funptrmap mval : ((Digest.t * string) IntMap.t * AbsByte.t list) =
+  let rec repr funptrmap mval : ((Symbol.digest * string) IntMap.t * AbsByte.t list) =
     let ret bs = (funptrmap, bs) in
     match mval with
       | MVunspecified ty ->
@@ -2607,39 +2607,159 @@ VIP:type pointer_value =
    let pp_pretty_integer_value ?basis ~use_upper = pp_integer_value
   let pp_pretty_mem_value ?basis ~use_upper = pp_mem_value
   
-  (* TODO check *)
+  (* INTERNAL: checks (once) that the [size_n] bytes starting at a pointer
+     are all within a live object, for the bulk operations on memory ranges
+     (memcpy, memcmp, realloc). Returns the allocation and the address. *)
+  let check_range loc ~is_write range_error (PV (prov, ptrval_)) size_n
+      : (storage_instance_id option * address) memM =
+    let within alloc_id addr =
+      get_allocation ~loc alloc_id >>= fun alloc ->
+      return (N.less_equal alloc.base addr && N.less_equal (N.add addr size_n) (N.add alloc.base alloc.size)) in
+    let check_writable alloc_id =
+      if is_write then
+        get_allocation ~loc alloc_id >>= fun alloc ->
+        match alloc.is_readonly with
+          | IsReadOnly ro_kind ->
+              fail ~loc (MerrWriteOnReadOnly ro_kind)
+          | IsWritable ->
+              return ()
+      else
+        return () in
+    match (prov, ptrval_) with
+      | (_, PVnull _) ->
+          fail ~loc (range_error `NullPtr)
+      | (_, PVfunction _) ->
+          fail ~loc (range_error `FunctionPtr)
+      | (Prov_none, _) ->
+          fail ~loc (range_error `NoProvPtr)
+      | (Prov_device, PVconcrete (_, addr)) ->
+          if List.exists (fun (min, max) ->
+               N.less_equal min addr && N.less_equal (N.add addr size_n) max
+             ) device_ranges then
+            return (None, addr)
+          else
+            fail ~loc (range_error `OutOfBoundPtr)
+      (* PNVI-ae-udi *)
+      | (Prov_symbolic iota, PVconcrete (_, addr)) ->
+          let precondition z =
+            is_dead z >>= begin function
+              | true ->
+                  return (`FAIL (loc, range_error `DeadPtr))
+              | false ->
+                  within z addr >>= begin function
+                    | false ->
+                        return (`FAIL (loc, range_error `OutOfBoundPtr))
+                    | true ->
+                        return `OK
+                  end
+            end in
+          resolve_iota precondition iota >>= fun alloc_id ->
+          check_writable alloc_id >>= fun () ->
+          return (Some alloc_id, addr)
+      | (Prov_some alloc_id, PVconcrete (_, addr)) ->
+          is_dead alloc_id >>= begin function
+            | true ->
+                fail ~loc (range_error `DeadPtr)
+            | false ->
+                within alloc_id addr
+          end >>= begin function
+            | false ->
+                fail ~loc (range_error `OutOfBoundPtr)
+            | true ->
+                check_writable alloc_id >>= fun () ->
+                return (Some alloc_id, addr)
+          end
+
+  let memcpy_range_error = function
+    | `NullPtr
+    | `FunctionPtr
+    | `NoProvPtr ->
+        MerrUndefinedMemcpy Memcpy_non_object
+    | `DeadPtr ->
+        MerrUndefinedMemcpy Memcpy_dead_object
+    | `OutOfBoundPtr ->
+        MerrUndefinedMemcpy Memcpy_out_of_bound
+
+  let load_range_error = function
+    | `NullPtr ->
+        MerrAccess (LoadAccess, NullPtr)
+    | `FunctionPtr ->
+        MerrAccess (LoadAccess, FunctionPtr)
+    | `NoProvPtr
+    | `OutOfBoundPtr ->
+        MerrAccess (LoadAccess, OutOfBoundPtr)
+    | `DeadPtr ->
+        MerrAccess (LoadAccess, DeadPtr)
+
+  (* The bytes are copied as they are (including their provenance and
+     pointer fragment offset), as for a copy of the object representation,
+     rather than going through a load and a store of each byte. *)
   let memcpy loc ptrval1 ptrval2 (IV (_, size_n)) =
-    (* TODO: if ptrval1 and ptrval2 overlap ==> UB *)
-    (* TODO: copy ptrval2 into ptrval1 *)
-    let rec aux i =
-      if Nat_big_num.less i size_n then
-        load loc Ctype.unsigned_char (array_shift_ptrval ptrval2 Ctype.unsigned_char (IV (Prov_none, i))) >>= fun (_, mval) ->
-        store loc Ctype.unsigned_char false (array_shift_ptrval ptrval1 Ctype.unsigned_char (IV (Prov_none, i))) mval >>= fun _ ->
-        aux (Nat_big_num.succ i)
+    if N.equal size_n N.zero then
+      return ptrval1
+    else
+      check_range loc ~is_write:true memcpy_range_error ptrval1 size_n >>= fun (alloc_id_opt, dst) ->
+      check_range loc ~is_write:false memcpy_range_error ptrval2 size_n >>= fun (_, src) ->
+      if N.less dst (N.add src size_n) && N.less src (N.add dst size_n) then
+        fail ~loc (MerrUndefinedMemcpy Memcpy_overlap)
       else
-        return ptrval1 in
-    aux Nat_big_num.zero
+        (* PNVI-ae-udi: the source bytes are read as unsigned chars, which
+           exposes them, as with a load *)
+        begin if Switches.(has_switch (SW_PNVI `AE) || has_switch (SW_PNVI `AE_UDI)) then
+          get >>= fun st ->
+          (* TODO: the N.to_int will fail on huge objects *)
+          expose_allocations (AbsByte.provs_of_bytes (fetch_bytes st.bytemap src (N.to_int size_n)))
+        else
+          return ()
+        end >>= fun () ->
+        update begin fun st ->
+          let rec aux i bytemap =
+            if N.less i size_n then
+              let dst_addr = N.add dst i in
+              aux (N.succ i) begin match IntMap.find_opt (N.add src i) st.bytemap with
+                | Some b ->
+                    IntMap.add dst_addr b bytemap
+                | None ->
+                    IntMap.remove dst_addr bytemap
+              end
+            else
+              bytemap in
+          { st with last_used= alloc_id_opt;
+                    bytemap= aux N.zero st.bytemap }
+        end >>= fun () ->
+        return ptrval1
   
   
-  (* TODO: validate more, but looks good *)
   let memcmp ptrval1 ptrval2 (IV (_, size_n)) =
-    let rec get_bytes ptrval acc = function
-      | 0 ->
-          return (List.rev acc)
-      | size ->
-          load Cerb_location.unknown Ctype.unsigned_char ptrval >>= function
-            | (_, MVinteger (_, (IV (byte_prov, byte_n)))) ->
-                let ptr' = array_shift_ptrval ptrval Ctype.unsigned_char (IV (Prov_none, Nat_big_num.(succ zero))) in
-                get_bytes ptr' (byte_n :: acc) (size-1)
-            | _ ->
-                assert false in
-     get_bytes ptrval1 [] (Nat_big_num.to_int size_n) >>= fun bytes1 ->
-     get_bytes ptrval2 [] (Nat_big_num.to_int size_n) >>= fun bytes2 ->
-     
-     let open Nat_big_num in
-     return (IV (Prov_none, List.fold_left (fun acc (n1, n2) ->
-                   if equal acc zero then of_int (Nat_big_num.compare n1 n2) else acc
-                 ) zero (List.combine bytes1 bytes2)))
+    let loc = Cerb_location.other "Concrete.memcmp" in
+    check_range loc ~is_write:false load_range_error ptrval1 size_n >>= fun (_, addr1) ->
+    check_range loc ~is_write:false load_range_error ptrval2 size_n >>= fun (_, addr2) ->
+    get >>= fun st ->
+    (* TODO: the N.to_int will fail on huge objects *)
+    let bs1 = fetch_bytes st.bytemap addr1 (N.to_int size_n) in
+    let bs2 = fetch_bytes st.bytemap addr2 (N.to_int size_n) in
+    (* PNVI-ae-udi: reading the bytes as unsigned chars exposes them, as
+       with a load *)
+    begin if Switches.(has_switch (SW_PNVI `AE) || has_switch (SW_PNVI `AE_UDI)) then
+      expose_allocations (AbsByte.provs_of_bytes bs1) >>= fun () ->
+      expose_allocations (AbsByte.provs_of_bytes bs2)
+    else
+      return ()
+    end >>= fun () ->
+    let rec aux bs1 bs2 =
+      match bs1, bs2 with
+        | [], _
+        | _, [] ->
+            return N.zero
+        | AbsByte.{ value= Some c1; _ } :: bs1', AbsByte.{ value= Some c2; _ } :: bs2' ->
+            if c1 = c2 then
+              aux bs1' bs2'
+            else
+              return (N.of_int (compare (Char.code c1) (Char.code c2)))
+        | _ ->
+            fail ~loc (MerrWIP "memcmp on unspecified bytes") in
+    aux bs1 bs2 >>= fun n ->
+    return (IV (Prov_none, n))
 
   let realloc loc tid align ptr size : pointer_value memM =
     match ptr with
@@ -149,7 +149,7 @@ type mem_state = {
   allocations: allocation IntMap.t; (* 'A' in the paper *)
   bytemap: AbsByte.t IntMap.t;      (* 'M' in the paper *) (* INVARIANT dom(M) \subset valid_addresses *)
   
-  funptrmap: (Digest.t * string) IntMap.t;
+  funptrmap: (Symbol.digest * string) IntMap.t;
 
   (* implementation stuff not visible in paper's math *)
   next_alloc_id: allocation_id;
@@ -293,7 +293,7 @@ end else
    Some (char_of_int (N.to_int (N.extract_num i (8*n) 8)))
  )
 
-let rec repr funptrmap mval : ((Digest.t * string) IntMap.t * AbsByte.t list) =
+let rec repr funptrmap mval : ((Symbol.digest * string) IntMap.t * AbsByte.t list) =
   let ret bs = (funptrmap, bs) in
   match mval with
     | MVunspecified ty ->
@@ -885,41 +885,80 @@ let eff_array_shift_ptrval loc ptrval ty ival : pointer_value memM =
 let eff_member_shift_ptrval _ tag_sym membr_ident ptrval =
   return (member_shift_ptrval tag_sym membr_ident ptrval)
 
+(* checks (once) that the [sz] bytes starting at a pointer are within a live
+   allocation, for memcpy and memcmp *)
+let check_range loc range_error ptrval sz : address memM =
+  match ptrval with
+    | PVnull ->
+        fail ~loc (range_error `NullPtr)
+    | PVloc (Prov_empty, _) ->
+        fail ~loc (range_error `NoProvPtr)
+    | PVloc (Prov_some alloc_id, addr) ->
+        lookup_alloc alloc_id >>= fun alloc ->
+        if alloc.killed then
+          fail ~loc (range_error `DeadPtr)
+        else if not (N.less_equal alloc.base addr
+                     && N.less_equal (N.add addr sz) (N.add alloc.base alloc.length)) then
+          fail ~loc (range_error `OutOfBoundPtr)
+        else
+          return addr
+    | PVfunptr _ ->
+        fail ~loc (range_error `FunctionPtr)
+
 let memcpy loc ptrval1 ptrval2 sz_ival : pointer_value memM =
   let sz = ival_to_int sz_ival in
-  (* TODO: if ptrval1 and ptrval2 overlap ==> UB *)
-  (* TODO: copy ptrval2 into ptrval1 *)
-  (* NOTE: we are using the pure array_shift because if we go out of bound there is a UB right away *)
-  let rec aux i =
-    if Nat_big_num.less i sz then
-      load loc Ctype.unsigned_char (array_shift_ptrval ptrval2 Ctype.unsigned_char (IVint i)) >>= fun (_, mval) ->
-      store loc Ctype.unsigned_char false (array_shift_ptrval ptrval1 Ctype.unsigned_char (IVint i)) mval >>= fun _ ->
-      aux (N.succ i)
+  let range_error = function
+    | `NullPtr | `NoProvPtr | `FunctionPtr -> MC.MerrUndefinedMemcpy MC.Memcpy_non_object
+    | `DeadPtr -> MC.MerrUndefinedMemcpy MC.Memcpy_dead_object
+    | `OutOfBoundPtr -> MC.MerrUndefinedMemcpy MC.Memcpy_out_of_bound in
+  if N.equal sz N.zero then
+    return ptrval1
+  else
+    check_range loc range_error ptrval1 sz >>= fun dst ->
+    check_range loc range_error ptrval2 sz >>= fun src ->
+    if N.less dst (N.add src sz) && N.less src (N.add dst sz) then
+      fail ~loc (MerrUndefinedMemcpy Memcpy_overlap)
     else
-      return ptrval1 in
-  aux N.zero
+      (* the bytes are copied with their provenance and pointer fragment index *)
+      update begin fun st ->
+        let rec aux i bytemap =
+          if N.less i sz then
+            aux (N.succ i) begin match IntMap.find_opt (N.add src i) st.bytemap with
+              | Some b -> IntMap.add (N.add dst i) b bytemap
+              | None -> IntMap.remove (N.add dst i) bytemap
+            end
+          else
+            bytemap in
+        { st with bytemap= aux N.zero st.bytemap }
+      end >>= fun () ->
+      return ptrval1
 
 let memcmp ptrval1 ptrval2 sz_ival : integer_value memM =
-  let size_n = ival_to_int sz_ival in
-  let rec get_bytes ptrval acc = function
-  | 0 ->
-      return (List.rev acc)
-  | size ->
-      load Cerb_location.unknown Ctype.unsigned_char ptrval >>= function
-        | (_, MVinteger (_, byte_ival)) ->
-            let ptr' = array_shift_ptrval ptrval Ctype.unsigned_char (IVint N.(succ zero)) in
-            get_bytes ptr' (ival_to_int byte_ival :: acc) (size-1)
+  let loc = Cerb_location.other "VIP.memcmp" in
+  let sz = ival_to_int sz_ival in
+  let range_error = function
+    | `NullPtr -> MC.MerrAccess (MC.LoadAccess, MC.NullPtr)
+    | `NoProvPtr -> MC.MerrAccess (MC.LoadAccess, MC.NoProvPtr)
+    | `FunctionPtr -> MC.MerrAccess (MC.LoadAccess, MC.FunctionPtr)
+    | `DeadPtr -> MC.MerrAccess (MC.LoadAccess, MC.DeadPtr)
+    | `OutOfBoundPtr -> MC.MerrAccess (MC.LoadAccess, MC.OutOfBoundPtr) in
+  check_range loc range_error ptrval1 sz >>= fun addr1 ->
+  check_range loc range_error ptrval2 sz >>= fun addr2 ->
+  get >>= fun st ->
+  let rec aux i =
+    if N.less i sz then
+      match IntMap.find_opt (N.add addr1 i) st.bytemap, IntMap.find_opt (N.add addr2 i) st.bytemap with
+        | Some AbsByte.{ value= Some c1; _ }, Some AbsByte.{ value= Some c2; _ } ->
+            if c1 = c2 then
+              aux (N.succ i)
+            else
+              return (N.of_int (compare (Char.code c1) (Char.code c2)))
         | _ ->
-            assert false in
-  get_bytes ptrval1 [] (Nat_big_num.to_int size_n) >>= fun bytes1 ->
-  get_bytes ptrval2 [] (Nat_big_num.to_int size_n) >>= fun bytes2 ->
-  
-  let open N in
-  return (
-    IVint (
-      List.fold_left (fun acc (n1, n2) ->
-        if equal acc zero then of_int (N.compare n1 n2) else acc
-      ) zero (List.combine bytes1 bytes2)))
+            fail ~loc (MerrWIP "memcmp on unspecified bytes")
+    else
+      return N.zero in
+  aux N.zero >>= fun n ->
+  return (IVint n)
 
 let realloc _ tid al_ival ptrval size_ival : pointer_value memM =
   not_implemented "VIP.realloc"
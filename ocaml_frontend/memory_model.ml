@@ -235,7 +235,7 @@ module type Memory = sig
 *)
 
   (* JSON serialisation *)
-  val serialise_mem_state: Digest.t -> mem_state -> Cerb_json.json
+  val serialise_mem_state: Symbol.digest -> mem_state -> Cerb_json.json
   
   
   
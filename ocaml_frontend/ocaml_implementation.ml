@@ -122,8 +122,10 @@ module DefaultImpl = struct
     Some 8
 
   (* INTERNAL *)
+  (* per domain, as the enums are those of the translation unit being
+     desugared *)
   let registered_enums =
-    ref []
+    Cerb_dls.new_key ~inherit:true (fun () -> [])
 
   (* NOTE: for enums implementation we follow GCC, since Clang doesn't document
      it's implementation details... *)
@@ -134,15 +136,16 @@ module DefaultImpl = struct
         Signed Int_
       else
         Unsigned Int_ in
-    if List.exists (fun (z, _) -> Symbol.symbol_compare z tag_sym = 0) !registered_enums then
+    let enums = Cerb_dls.get registered_enums in
+    if List.exists (fun (z, _) -> Symbol.symbol_compare z tag_sym = 0) enums then
       false
     else begin
-      registered_enums := (tag_sym, ity) :: !registered_enums;
+      Cerb_dls.set registered_enums ((tag_sym, ity) :: enums);
       true
     end
 
   let typeof_enum tag_sym =
-    match List.find_opt (fun (z, _) -> Symbol.symbol_compare z tag_sym = 0) !registered_enums with
+    match List.find_opt (fun (z, _) -> Symbol.symbol_compare z tag_sym = 0) (Cerb_dls.get registered_enums) with
       | None ->
           failwith ("Ocaml_implementation.typeof_enum: '" ^
                     Symbol.instance_Show_Show_Symbol_sym_dict.show_method tag_sym ^ "' was not registered")
@@ -0,0 +1,150 @@
+(* Resolution pass run after Core_linking, so that the interpreter does not
+   have to look up in the maps of the file what is known statically:
+    - the implementation constants (PEimpl) whose definitions are values are
+      replaced by these values;
+    - with the elide_range_checks switch, the integer conversions and overflow
+      checks (conv_int, wrapI, catch_exceptional_condition) of constants whose
+      result is representable are replaced by that result (the Core-level
+      counterpart of the ranges used by the elaboration).
+   Calls to impl functions, stdlib functions and procedures are not resolved:
+   Core has no node for a pre-resolved callee, so Core_eval and
+   Core_run.call_proc still look them up in the maps of the file (the
+   closure evaluator, Closure_eval, resolves them once when compiling). *)
+open Core_rewriter
+open Core
+
+module RW = Rewriter(Identity_monad)
+
+
+(* the implementation constants whose definition is (or aliases) a value *)
+let impl_values impl =
+  let rec value_of seen iCst =
+    if List.mem iCst seen then
+      None
+    else match Pmap.lookup iCst impl with
+      | Some (Def (_, Pexpr (_, _, PEval cval))) ->
+          Some cval
+      | Some (Def (_, Pexpr (_, _, PEimpl iCst'))) ->
+          value_of (iCst :: seen) iCst'
+      | _ ->
+          None in
+  Pmap.fold (fun iCst _ acc ->
+    match value_of [] iCst with
+      | Some cval -> Pmap.add iCst cval acc
+      | None -> acc
+  ) impl (Pmap.empty Implementation.implementation_constant_compare)
+
+(* the value of a specified integer constant, if [pe] is one *)
+let integer_constant (Pexpr (_, _, pe_)) =
+  match pe_ with
+    | PEval (Vobject (OVinteger ival))
+    | PEval (Vloaded (LVspecified (OVinteger ival))) ->
+        Option.map (fun _ -> ival) (Mem.eval_integer_value ival)
+    | _ ->
+        None
+
+let is_representable ity n =
+  match Mem.eval_integer_value (Mem.min_ival ity), Mem.eval_integer_value (Mem.max_ival ity) with
+    | Some min, Some max ->
+        Nat_big_num.less_equal min n && Nat_big_num.less_equal n max
+    | _ ->
+        false
+
+let fold_iop iop ival1 ival2 =
+  let op = match iop with
+    | IOpAdd -> Some Mem_common.IntAdd
+    | IOpSub -> Some Mem_common.IntSub
+    | IOpMul -> Some Mem_common.IntMul
+    | IOpShl | IOpShr -> None in
+  Option.map (fun op -> Mem.op_ival op ival1 ival2) op
+
+(* [conv_int], [wrapI] and [catch_exceptional_condition] are the identity on
+   representable results *)
+let fold_range_check (Pexpr (annots, bTy, pexpr_) as pexpr) =
+  let to_value ival = Pexpr (annots, bTy, PEval (Vobject (OVinteger ival))) in
+  let fold ity ival =
+    match Mem.eval_integer_value ival with
+      | Some n when is_representable ity n -> to_value ival
+      | _ -> pexpr in
+  match pexpr_ with
+    | PEconv_int (ity, pe) ->
+        begin match integer_constant pe with
+          | Some ival -> fold ity ival
+          | None -> pexpr
+        end
+    | PEwrapI (ity, iop, pe1, pe2)
+    | PEcatch_exceptional_condition (ity, iop, pe1, pe2) ->
+        begin match integer_constant pe1, integer_constant pe2 with
+          | Some ival1, Some ival2 ->
+              begin match fold_iop iop ival1 ival2 with
+                | Some ival -> fold ity ival
+                | None -> pexpr
+              end
+          | _ ->
+              pexpr
+        end
+    | _ ->
+        pexpr
+
+let rewriter file : 'bty RW.rewriter =
+  let values = impl_values file.impl in
+  let elide = Switches.(has_switch SW_elide_range_checks) && not (Switches.is_CHERI ()) in
+  let open RW in {
+    rw_pexpr=
+      RW.RW begin fun _ (Pexpr (annots, bTy, pexpr_)) ->
+        match pexpr_ with
+          | PEconv_int _
+          | PEwrapI _
+          | PEcatch_exceptional_condition _ when elide ->
+              DoChildrenPost (fun pexpr -> Identity_monad.return (fold_range_check pexpr))
+          | PEimpl iCst ->
+              begin match Pmap.lookup iCst values with
+                | Some cval -> Update (Identity_monad.return (Pexpr (annots, bTy, PEval cval)))
+                | None -> Unchanged
+              end
+          | _ ->
+              Traverse
+      end;
+    rw_action=
+      RW.RW begin fun _ _ ->
+        Traverse
+      end;
+    rw_expr=
+      RW.RW begin fun _ _ ->
+        Traverse
+      end
+   }
+
+let rewrite_file file =
+  let rw = rewriter file in
+  let rewrite_pexpr pexpr =
+    Identity_monad.unwrap RW.(rewritePexpr rw pexpr) in
+  let rewrite_expr expr =
+    Identity_monad.unwrap RW.(rewriteExpr rw expr) in
+
+  let rewrite_impl_decl = function
+    | Def (bTy, pe) ->
+        Def (bTy, rewrite_pexpr pe)
+    | IFun (bTy, args, pe) ->
+        IFun (bTy, args, rewrite_pexpr pe) in
+
+  let rewrite_fun_map_decl = function
+    | Fun (bTy, args, pe) ->
+        Fun (bTy, args, rewrite_pexpr pe)
+    | Proc (loc, mrk, bTy, args, e) ->
+        Proc (loc, mrk, bTy, args, rewrite_expr e)
+    | decl ->
+        decl in
+
+  let rewrite_globs = function
+    | GlobalDef (bTy, e) ->
+        GlobalDef (bTy, rewrite_expr e)
+    | decl ->
+        decl in
+
+  { file with
+    stdlib = Pmap.map rewrite_fun_map_decl file.stdlib
+  ; impl = Pmap.map rewrite_impl_decl file.impl
+  ; globs = List.map (fun (sym, glob) -> (sym, rewrite_globs glob)) file.globs
+  ; funs = Pmap.map rewrite_fun_map_decl file.funs
+  }
@@ -40,6 +40,10 @@ type cerb_switch =
   (* set magic comment syntax to "/*$ ... $*/" *)
   | SW_magic_comment_char_dollar
 
+  (* the elaboration uses the types and constants of integer expressions to
+     drop the conversions and the overflow checks shown to be the identity *)
+  | SW_elide_range_checks
+
 
 let internal_ref =
   ref []
@@ -94,6 +98,8 @@ let set strs =
         Some SW_at_magic_comments
     | "magic_comment_char_dollar" ->
         Some (SW_magic_comment_char_dollar)
+    | "elide_range_checks" ->
+        Some SW_elide_range_checks
     | _ ->
         None in
   let pred x = function
@@ -122,7 +128,8 @@ let set strs =
     | SW_permissive_printf
     | SW_zero_initialised
     | SW_at_magic_comments
-    | SW_magic_comment_char_dollar as y ->
+    | SW_magic_comment_char_dollar
+    | SW_elide_range_checks as y ->
         x = y in
   List.iter (fun str ->
     match read_switch str with
@@ -40,6 +40,10 @@ type cerb_switch =
   (* set magic comment syntax to "/*$ ... $*/" *)
   | SW_magic_comment_char_dollar
 
+  (* the elaboration uses the types and constants of integer expressions to
+     drop the conversions and the overflow checks shown to be the identity *)
+  | SW_elide_range_checks
+
 val get_switches: unit -> cerb_switch list
 val has_switch: cerb_switch -> bool
 val has_switch_pred: (cerb_switch -> bool) -> cerb_switch option
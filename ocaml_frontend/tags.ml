@@ -1,27 +1,28 @@
 open Ctype
 
+(* per domain, as the tag definitions are those of the file being processed *)
 let _tagDefs =
-  ref (false, None)
+  Cerb_dls.new_key (fun () -> (false, None))
 
 let reset_tagDefs () =
-  _tagDefs := (false, None)
+  Cerb_dls.set _tagDefs (false, None)
 
 let set_tagDefs v =
-  if fst !_tagDefs then
+  if fst (Cerb_dls.get _tagDefs) then
     failwith "Tags definitions can be set only once"
   else
-    _tagDefs := (true, Some v)
+    Cerb_dls.set _tagDefs (true, Some v)
 
 let tagDefs () =
-  match snd !_tagDefs with
+  match snd (Cerb_dls.get _tagDefs) with
     | Some v ->
         v
     | None ->
         failwith "Tags definitions must be set by Tags.set_tagDefs before any use"
 
 let with_tagDefs tagDefs f =
-  let saved = !_tagDefs in
-  _tagDefs := (true, Some tagDefs);
+  let saved = Cerb_dls.get _tagDefs in
+  Cerb_dls.set _tagDefs (true, Some tagDefs);
    let ret = f () in
-  _tagDefs := saved;
+  Cerb_dls.set _tagDefs saved;
   ret
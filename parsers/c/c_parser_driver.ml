@@ -1,23 +1,28 @@
 open Cerb_frontend
 
-let after_before_msg offset buffer (lexbuf : Lexing.lexbuf) =
+let after_before_msg buffer (lexbuf : Lexing.lexbuf) =
+  (* The lexer only ever advances [pos_cnum] together with the buffer, so the
+     index of a position in the buffer is relative to the current one. This
+     holds whether the lexbuf is over a string or a channel (in which case
+     tokens which are no longer in the buffer cannot be shown). *)
+  let index pos =
+    lexbuf.lex_curr_pos - (lexbuf.lex_curr_p.pos_cnum - pos.Lexing.pos_cnum) in
   let show_token (start, curr) =
     try
       Lexing.lexeme {
         lexbuf with
-        lex_start_pos = start.Lexing.pos_cnum - offset;
-        lex_curr_pos = curr.Lexing.pos_cnum - offset;
+        lex_start_pos = index start;
+        lex_curr_pos = index curr;
       }
     with Invalid_argument _ ->
       Printf.sprintf
-        "CPARSER_DRIVER(lex_buffer_len = %d; offset = %d; start_index = %d; end_index = %d)"
+        "CPARSER_DRIVER(lex_buffer_len = %d; start_index = %d; end_index = %d)"
         lexbuf.lex_buffer_len
-        offset
-        (start.pos_cnum - offset)
-        (curr.pos_cnum - offset) in
+        (index start)
+        (index curr) in
   MenhirLib.ErrorReports.show show_token buffer
 
-let handle parse (token_pos_buffer, lexer) ~offset lexbuf =
+let handle parse (token_pos_buffer, lexer) lexbuf =
   try Exception.except_return (parse lexer lexbuf) with
   | C_lexer.Error err ->
     let loc = Cerb_location.point @@ Lexing.lexeme_start_p lexbuf in
@@ -33,7 +38,7 @@ let handle parse (token_pos_buffer, lexer) ~offset lexbuf =
     let message = String.sub message 0 (String.length message - 1) in
     let range = (Lexing.lexeme_start_p lexbuf, Lexing.lexeme_end_p lexbuf) in
     let loc = Cerb_location.(region range NoCursor) in
-    let where = after_before_msg offset token_pos_buffer lexbuf in
+    let where = after_before_msg token_pos_buffer lexbuf in
     Exception.fail (loc, Errors.CPARSER (Errors.Cparser_unexpected_token  (where ^ "\n" ^ message)))
   | Failure msg ->
     prerr_endline "CPARSER_DRIVER (Failure)";
@@ -82,7 +87,6 @@ let parse_loc_string parse (loc, str) =
   handle
     parse
     (MenhirLib.ErrorReports.wrap cn_lexer)
-    ~offset:start_pos.pos_cnum
     lexbuf
 
 let update_enclosing_region payload_region xs =
@@ -129,13 +133,19 @@ let parse_with_magic_comments lexbuf =
   handle
     C_parser.translation_unit
     (MenhirLib.ErrorReports.wrap c_lexer)
-    ~offset:0
     lexbuf
 
 let parse lexbuf =
   Exception.except_bind (parse_with_magic_comments lexbuf)
     magic_comments_to_cn_toplevel
 
+(* Parses from a channel as it is read (e.g. the output of cpp), rather than
+   first collecting the whole translation unit in a string *)
+let parse_channel ~filename ic =
+  let lexbuf = Lexing.from_channel ic in
+  Lexing.set_filename lexbuf filename;
+  parse lexbuf
+
 let parse_from_channel input =
   let read f input =
     let channel = open_in input in
@@ -143,8 +153,7 @@ let parse_from_channel input =
     let ()      = close_in channel in
     result
   in
-  let parse_channel ic = parse @@ Lexing.from_channel ic in
-  read parse_channel input
+  read (parse_channel ~filename:input) input
 
 let parse_from_string ~filename str =
   let lexbuf = Lexing.from_string str in
@@ -47,24 +47,27 @@ let cerb_builtin_types =
     "max_align_t"
   ]
 
-let current =
-  List.map (fun s -> "__cerbty_" ^ s) cerb_builtin_types
-  |> IdSet.of_list
-  |> ref
+(* the typedef names in scope, per domain so that files can be parsed in
+   parallel *)
+let current : context Cerb_dls.key =
+  Cerb_dls.new_key begin fun () ->
+    List.map (fun s -> "__cerbty_" ^ s) cerb_builtin_types
+    |> IdSet.of_list
+  end
 
 let declare_typedefname id =
-  current := IdSet.add id !current
+  Cerb_dls.set current (IdSet.add id (Cerb_dls.get current))
 
 let declare_varname id =
-  current := IdSet.remove id !current
+  Cerb_dls.set current (IdSet.remove id (Cerb_dls.get current))
 
 let is_typedefname id =
-  IdSet.mem id !current
+  IdSet.mem id (Cerb_dls.get current)
 
-let save_context () = !current
+let save_context () = Cerb_dls.get current
 
 let restore_context ctxt =
-  current := ctxt
+  Cerb_dls.set current ctxt
 
 type decl_sort =
   | DeclId
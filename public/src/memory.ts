@@ -57,6 +57,37 @@ export type State = {
   last_used: number | null
 }
 
+/** When stepping, the memory of a node is sent as its difference with the
+ *  memory of its parent: fields keyed by allocation id only list the changed
+ *  and removed allocations, the other fields are sent whole */
+type FieldDelta =
+  | { changed: {[key:string]: any}, removed: string[] }
+  | { value: any }
+
+export type Delta = {
+  delta: number     // id of the parent node
+  fields: {[key:string]: FieldDelta}
+}
+
+export function isDelta (m: any): m is Delta {
+  return m != undefined && m.delta != undefined
+}
+
+export function applyDelta (parent: State, d: Delta): State {
+  const mem: any = {}
+  for (const key in d.fields) {
+    const f = d.fields[key]
+    if ('value' in f) {
+      mem[key] = f.value
+    } else {
+      const m = { ...(parent as any)[key] }
+      f.removed.forEach(id => delete m[id])
+      mem[key] = Object.assign(m, f.changed)
+    }
+  }
+  return mem as State
+}
+
 /** Value points to some place in the memory */
 export function pointsto (v: Value): boolean {
   return v.value != 'NULL' && (v.kind == 'pointer' || v.kind == 'intptr')
@@ -663,10 +663,18 @@ export default class View {
       throw new Error('Active point in update Interactive is undefined!')
     active.can_step = false
     delete active.state
-    // Add nodes
+    // Add nodes (in creation order, so parents come before their children)
+    const parents = new Map<number, number>()
+    tree.edges.map(e => parents.set(e.to, e.from))
     tree.nodes.map((n) => {
       n.isTau = n && n.info.kind == 'step' && n.info.step_kind.kind == 'tau' && tree.siblings(n.id).length == 1
       n.isVisible = false
+      if (Memory.isDelta(n.mem)) {
+        const parent = graph.nodes[n.mem.delta]
+        if (!parent || !parent.mem || parents.get(n.id) != n.mem.delta)
+          throw new Error('Memory delta of node ' + n.id + ' has no parent memory!')
+        n.mem = Memory.applyDelta(parent.mem, n.mem)
+      }
       graph.nodes.push(n)
     })
     // Edges are added twice (for tau transitions)
@@ -675,7 +683,7 @@ export default class View {
       graph.edges.push(e)
     })
     tree.edges.map((e) => {
-      const n = _.find(graph.nodes, n => n.id == e.to)
+      const n = graph.nodes[e.to]
       if (n && !n.isTau) {
         const from = graph.getNoTauParent(e.to)
         if (from != undefined)
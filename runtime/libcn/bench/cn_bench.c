@@ -0,0 +1,455 @@
+// Microbenchmarks for the Fulminate runtime (libcn).
+//
+// Each benchmark runs a fixed number of batches of a fixed number of
+// operations, and reports per-operation latency (median and 99th percentile
+// over the batches) and throughput. Parameters are varied over the size of
+// the ownership ghost state and over the size of the accessed objects.
+//
+// Usage: cn_bench [--json] [--quick] [--filter SUBSTRING]
+//
+// With --json, the results are printed in the format read by
+// github-action-benchmark ("customSmallerIsBetter"), so that they can be
+// tracked alongside the CN benchmarks.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <cn-executable/alloc.h>
+#include <cn-executable/hash_table.h>
+#include <cn-executable/utils.h>
+
+#define MAX_BATCHES 64
+
+static int json_output = 0;
+static int quick = 0;
+static const char* filter = NULL;
+static int results_printed = 0;
+
+static volatile uintptr_t sink;
+
+static double now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+static int compare_doubles(const void* a, const void* b) {
+  double x = *(const double*)a;
+  double y = *(const double*)b;
+  return (x > y) - (x < y);
+}
+
+struct bench_result {
+  double median_ns;
+  double p99_ns;
+  double min_ns;
+  double ops_per_sec;
+};
+
+static struct bench_result summarise(double* samples, int batches) {
+  struct bench_result res;
+  qsort(samples, batches, sizeof(double), compare_doubles);
+  res.median_ns = samples[batches / 2];
+  res.p99_ns = samples[(batches * 99) / 100 < batches ? (batches * 99) / 100 : batches - 1];
+  res.min_ns = samples[0];
+  res.ops_per_sec = res.median_ns > 0 ? 1e9 / res.median_ns : 0;
+  return res;
+}
+
+static void report(const char* name, struct bench_result res) {
+  if (json_output) {
+    printf("%s  {\n", results_printed ? ",\n" : "[\n");
+    printf("    \"name\": \"libcn/%s\",\n", name);
+    printf("    \"unit\": \"ns/op\",\n");
+    printf("    \"value\": %.2f,\n", res.median_ns);
+    printf("    \"extra\": \"p99 %.2f ns/op; min %.2f ns/op; %.0f ops/s\"\n",
+        res.p99_ns,
+        res.min_ns,
+        res.ops_per_sec);
+    printf("  }");
+  } else {
+    printf("%-48s %12.2f %12.2f %14.0f\n",
+        name,
+        res.median_ns,
+        res.p99_ns,
+        res.ops_per_sec);
+  }
+  results_printed = 1;
+}
+
+static int selected(const char* name) {
+  return filter == NULL || strstr(name, filter) != NULL;
+}
+
+// Start every benchmark from an empty runtime state: this releases the bump
+// and free-list memory used by the previous one.
+static void fresh_runtime(void) {
+  reset_fulminate();
+  set_cn_logging_level(CN_LOGGING_NONE);
+}
+
+// Pre-populate the ownership ghost state with `table_bytes` bytes owned at
+// stack depth 0, away from the addresses used by the measured operations.
+static char* populate_ownership(size_t table_bytes) {
+  char* region = malloc(table_bytes ? table_bytes : 1);
+  c_add_to_ghost_state((uintptr_t)region, table_bytes, 0);
+  return region;
+}
+
+typedef void (*batch_fn)(void* env, int ops);
+
+static void run_bench(const char* name, batch_fn f, void* env, int batches, int ops) {
+  double samples[MAX_BATCHES];
+  if (batches > MAX_BATCHES) {
+    batches = MAX_BATCHES;
+  }
+  // warm-up
+  f(env, ops);
+  for (int b = 0; b < batches; b++) {
+    double start = now_ns();
+    f(env, ops);
+    samples[b] = (now_ns() - start) / ops;
+  }
+  report(name, summarise(samples, batches));
+}
+
+/* Ownership: cn_get_or_put_ownership */
+
+struct ownership_env {
+  char* object;
+  size_t size;
+};
+
+static void batch_get_put(void* p, int ops) {
+  struct ownership_env* env = p;
+  // the ghost state keeps pointers into the bump allocator, so the memory
+  // allocated here is only released by the next fresh_runtime()
+  for (int i = 0; i < ops; i++) {
+    cn_get_or_put_ownership(GET, (uintptr_t)env->object, env->size);
+    cn_get_or_put_ownership(PUT, (uintptr_t)env->object, env->size);
+  }
+}
+
+static void batch_ownership_check(void* p, int ops) {
+  struct ownership_env* env = p;
+  for (int i = 0; i < ops; i++) {
+    c_ownership_check("Load", (uintptr_t)env->object, (int)env->size, 0);
+  }
+}
+
+static void bench_ownership(size_t table_bytes, size_t size) {
+  char name[128];
+  struct ownership_env env;
+
+  snprintf(name, sizeof(name), "get_put_ownership/table=%zu/size=%zu", table_bytes, size);
+  if (selected(name)) {
+    fresh_runtime();
+    char* region = populate_ownership(table_bytes);
+    env.object = malloc(size);
+    env.size = size;
+    c_add_to_ghost_state((uintptr_t)env.object, size, 0);
+    ghost_stack_depth_incr();
+    // every GET/PUT pair allocates 4 * size bump cells: keep the batches small
+    int ops = (int)((quick ? 2000 : 20000) / size);
+    run_bench(name, batch_get_put, &env, quick ? 8 : 32, ops > 0 ? ops : 1);
+    free(env.object);
+    free(region);
+  }
+
+  snprintf(name, sizeof(name), "c_ownership_check/table=%zu/size=%zu", table_bytes, size);
+  if (selected(name)) {
+    fresh_runtime();
+    char* region = populate_ownership(table_bytes);
+    env.object = malloc(size);
+    env.size = size;
+    c_add_to_ghost_state((uintptr_t)env.object, size, 0);
+    int ops = (int)((quick ? 20000 : 200000) / size);
+    run_bench(name, batch_ownership_check, &env, quick ? 8 : 32, ops > 0 ? ops : 1);
+    free(env.object);
+    free(region);
+  }
+}
+
+/* Leak checks */
+
+static void batch_postcondition_leak_check(void* p, int ops) {
+  (void)p;
+  for (int i = 0; i < ops; i++) {
+    cn_postcondition_leak_check();
+  }
+}
+
+static void batch_loop_leak_check(void* p, int ops) {
+  (void)p;
+  for (int i = 0; i < ops; i++) {
+    cn_loop_leak_check_and_put_back_ownership();
+  }
+}
+
+static void bench_leak_checks(size_t table_bytes) {
+  char name[128];
+  int ops = table_bytes >= 100000 ? 1 : (quick ? 10 : 100);
+
+  snprintf(name, sizeof(name), "postcondition_leak_check/table=%zu", table_bytes);
+  if (selected(name)) {
+    fresh_runtime();
+    char* region = populate_ownership(table_bytes);
+    // everything is owned at depth 0 <= current depth: no leak
+    ghost_stack_depth_incr();
+    run_bench(name, batch_postcondition_leak_check, NULL, quick ? 4 : 16, ops);
+    free(region);
+  }
+
+  snprintf(name, sizeof(name), "loop_leak_check/table=%zu", table_bytes);
+  if (selected(name)) {
+    fresh_runtime();
+    char* region = populate_ownership(table_bytes);
+    // nothing at depth 1 (leak) or 2 (put back): the check only iterates
+    ghost_stack_depth_incr();
+    ghost_stack_depth_incr();
+    run_bench(name, batch_loop_leak_check, NULL, quick ? 4 : 16, ops);
+    free(region);
+  }
+}
+
+/* Hash table */
+
+struct ht_env {
+  hash_table* table;
+  signed long* keys;
+  int nkeys;
+  int next;
+};
+
+static void batch_ht_get_hit(void* p, int ops) {
+  struct ht_env* env = p;
+  uintptr_t acc = 0;
+  for (int i = 0; i < ops; i++) {
+    acc += (uintptr_t)ht_get(env->table, &env->keys[i % env->nkeys]);
+  }
+  sink = acc;
+}
+
+static void batch_ht_get_miss(void* p, int ops) {
+  struct ht_env* env = p;
+  uintptr_t acc = 0;
+  for (int i = 0; i < ops; i++) {
+    signed long key = -1 - i;
+    acc += (uintptr_t)ht_get(env->table, &key);
+  }
+  sink = acc;
+}
+
+static void batch_ht_set_update(void* p, int ops) {
+  struct ht_env* env = p;
+  for (int i = 0; i < ops; i++) {
+    ht_set(env->table, &env->keys[i % env->nkeys], env);
+  }
+}
+
+static void batch_ht_set_insert(void* p, int ops) {
+  struct ht_env* env = p;
+  for (int i = 0; i < ops; i++) {
+    signed long key = env->next++;
+    ht_set(env->table, &key, env);
+  }
+}
+
+static void bench_hash_table(int nkeys) {
+  char name[128];
+  struct ht_env env;
+  int ops = quick ? 10000 : 100000;
+
+  fresh_runtime();
+  env.table = ht_create();
+  env.keys = malloc(sizeof(signed long) * nkeys);
+  env.nkeys = nkeys;
+  for (int i = 0; i < nkeys; i++) {
+    // spread the keys like byte addresses of a heap object
+    env.keys[i] = 0x10000000L + i;
+    ht_set(env.table, &env.keys[i], &env);
+  }
+  env.next = 0x20000000;
+
+  snprintf(name, sizeof(name), "ht_get_hit/size=%d", nkeys);
+  if (selected(name)) {
+    run_bench(name, batch_ht_get_hit, &env, quick ? 8 : 32, ops);
+  }
+  snprintf(name, sizeof(name), "ht_get_miss/size=%d", nkeys);
+  if (selected(name)) {
+    run_bench(name, batch_ht_get_miss, &env, quick ? 8 : 32, ops);
+  }
+  snprintf(name, sizeof(name), "ht_set_update/size=%d", nkeys);
+  if (selected(name)) {
+    run_bench(name, batch_ht_set_update, &env, quick ? 8 : 32, ops);
+  }
+  snprintf(name, sizeof(name), "ht_set_insert/size=%d", nkeys);
+  if (selected(name)) {
+    // inserts grow the table (including its rehashing) from `nkeys` entries
+    run_bench(name, batch_ht_set_insert, &env, quick ? 4 : 8, ops);
+  }
+  free(env.keys);
+}
+
+/* Allocators */
+
+struct alloc_env {
+  size_t size;
+  void** live;
+  int nlive;
+};
+
+static void batch_bump(void* p, int ops) {
+  struct alloc_env* env = p;
+  cn_bump_frame_id frame = cn_bump_get_frame_id();
+  uintptr_t acc = 0;
+  for (int i = 0; i < ops; i++) {
+    acc += (uintptr_t)cn_bump_malloc(env->size);
+  }
+  cn_bump_free_after(frame);
+  sink = acc;
+}
+
+static void batch_fl(void* p, int ops) {
+  struct alloc_env* env = p;
+  for (int i = 0; i < ops; i++) {
+    void* q = cn_fl_malloc(env->size);
+    cn_fl_free(q);
+  }
+}
+
+static void bench_allocators(size_t size, int nlive) {
+  char name[128];
+  struct alloc_env env;
+  env.size = size;
+
+  snprintf(name, sizeof(name), "bump_malloc/size=%zu", size);
+  if (nlive == 0 && selected(name)) {
+    fresh_runtime();
+    int ops = (int)((quick ? 1 : 8) * 1024 * 1024 / size);
+    run_bench(name, batch_bump, &env, quick ? 8 : 32, ops > 0 ? ops : 1);
+  }
+
+  snprintf(name, sizeof(name), "fl_malloc_free/size=%zu/live=%d", size, nlive);
+  if (selected(name)) {
+    fresh_runtime();
+    // fragment the free list: keep every other block of `2 * nlive` alive
+    env.live = malloc(sizeof(void*) * (2 * nlive + 1));
+    for (int i = 0; i < 2 * nlive; i++) {
+      env.live[i] = cn_fl_malloc(size);
+    }
+    for (int i = 0; i < 2 * nlive; i += 2) {
+      cn_fl_free(env.live[i]);
+    }
+    env.nlive = nlive;
+    int ops = nlive >= 10000 ? 100 : (quick ? 1000 : 10000);
+    run_bench(name, batch_fl, &env, quick ? 8 : 32, ops);
+    free(env.live);
+  }
+}
+
+/* Error message context */
+
+static void batch_msg_info(void* p, int ops) {
+  (void)p;
+  for (int i = 0; i < ops; i++) {
+    update_cn_error_message_info("bench");
+    update_cn_error_message_info_access_check(NULL);
+    cn_pop_msg_info();
+    cn_pop_msg_info();
+  }
+}
+
+static void bench_msg_info(void) {
+  if (selected("error_msg_info_push_pop")) {
+    fresh_runtime();
+    initialise_error_msg_info();
+    run_bench("error_msg_info_push_pop", batch_msg_info, NULL, quick ? 8 : 32, 100000);
+  }
+}
+
+/* Boxed arithmetic */
+
+static void batch_boxed_arith(void* p, int ops) {
+  (void)p;
+  cn_bump_frame_id frame = cn_bump_get_frame_id();
+  cn_bits_i32* acc = convert_to_cn_bits_i32(0);
+  cn_bits_i32* one = convert_to_cn_bits_i32(1);
+  for (int i = 0; i < ops; i++) {
+    cn_bits_i32* x = convert_to_cn_bits_i32(i);
+    acc = cn_bits_i32_add(acc, cn_bits_i32_multiply(x, one));
+    if (convert_from_cn_bool(cn_bits_i32_lt(acc, x))) {
+      acc = cn_bits_i32_sub(acc, one);
+    }
+  }
+  sink = (uintptr_t)convert_from_cn_bits_i32(acc);
+  cn_bump_free_after(frame);
+}
+
+static void bench_boxed_arith(void) {
+  if (selected("boxed_arith/i32")) {
+    fresh_runtime();
+    run_bench("boxed_arith/i32", batch_boxed_arith, NULL, quick ? 8 : 32, 10000);
+  }
+}
+
+int main(int argc, char** argv) {
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--json") == 0) {
+      json_output = 1;
+    } else if (strcmp(argv[i], "--quick") == 0) {
+      quick = 1;
+    } else if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc) {
+      filter = argv[++i];
+    } else {
+      fprintf(stderr, "usage: %s [--json] [--quick] [--filter SUBSTRING]\n", argv[0]);
+      return 1;
+    }
+  }
+
+  initialise_ownership_ghost_state();
+  initialise_ghost_stack_depth();
+
+  if (!json_output) {
+    printf("%-48s %12s %12s %14s\n", "benchmark", "ns/op (p50)", "ns/op (p99)", "ops/s");
+  }
+
+  size_t table_sizes[] = {0, 10000, 1000000};
+  size_t object_sizes[] = {1, 8, 64, 512};
+  for (int t = 0; t < 3; t++) {
+    for (int s = 0; s < 4; s++) {
+      bench_ownership(table_sizes[t], object_sizes[s]);
+    }
+  }
+
+  size_t leak_table_sizes[] = {1000, 100000, 1000000};
+  for (int t = 0; t < 3; t++) {
+    bench_leak_checks(leak_table_sizes[t]);
+  }
+
+  int ht_sizes[] = {16, 10000, 1000000};
+  for (int t = 0; t < 3; t++) {
+    bench_hash_table(ht_sizes[t]);
+  }
+
+  size_t alloc_sizes[] = {8, 64, 4096};
+  int live_blocks[] = {0, 1000, 10000};
+  for (int s = 0; s < 3; s++) {
+    for (int l = 0; l < 3; l++) {
+      bench_allocators(alloc_sizes[s], live_blocks[l]);
+    }
+  }
+
+  bench_msg_info();
+
+  bench_boxed_arith();
+
+  if (json_output) {
+    printf("%s]\n", results_printed ? "\n" : "[");
+  }
+
+  return 0;
+}
@@ -39,47 +39,105 @@ enum cn_trace_granularity get_cn_trace_granularity(void);
 enum cn_trace_granularity set_cn_trace_granularity(
     enum cn_trace_granularity new_granularity);
 
+/* Building with -DCN_LOGGING_LEVEL=N and/or -DCN_TRACE_GRANULARITY=N (N being
+   the numeric value of one of the enumerators above) fixes the level at
+   compile time: the tests below fold to constants, disabled logging is
+   compiled out and, with CN_LOGGING_LEVEL=0, so is the error message context
+   (see below). The instrumented main calls initialise_cn_logging() to make
+   the runtime library agree. */
+
+#ifdef CN_LOGGING_LEVEL
+#define CN_CURRENT_LOGGING_LEVEL() ((enum cn_logging_level)(CN_LOGGING_LEVEL))
+#else
+#define CN_CURRENT_LOGGING_LEVEL() get_cn_logging_level()
+#endif
+
+#ifdef CN_TRACE_GRANULARITY
+#define CN_CURRENT_TRACE_GRANULARITY()                                                   \
+  ((enum cn_trace_granularity)(CN_TRACE_GRANULARITY))
+#else
+#define CN_CURRENT_TRACE_GRANULARITY() get_cn_trace_granularity()
+#endif
+
+static inline void initialise_cn_logging(void) {
+#ifdef CN_LOGGING_LEVEL
+  set_cn_logging_level((enum cn_logging_level)(CN_LOGGING_LEVEL));
+#endif
+#ifdef CN_TRACE_GRANULARITY
+  set_cn_trace_granularity((enum cn_trace_granularity)(CN_TRACE_GRANULARITY));
+#endif
+}
+
 #define cn_printf(level, ...)                                                            \
-  if (get_cn_logging_level() >= level) {                                                 \
+  if (CN_CURRENT_LOGGING_LEVEL() >= level) {                                             \
     printf(__VA_ARGS__);                                                                 \
   }
 
 void cn_print_nr_owned_predicates(void);
 
+/* Error message context: a stack of source locations, printed on failure.
+   Each record is a `static const` emitted at the instrumentation point, so
+   pushing and popping only moves a pointer in a preallocated array. */
+
 struct cn_error_message_info {
   const char *function_name;
-  char *file_name;
+  const char *file_name;
   int line_number;
-  char *cn_source_loc;
-  struct cn_error_message_info *parent;
-  struct cn_error_message_info *child;
+  const char *cn_source_loc;
 };
 
-void initialise_error_msg_info_(
-    const char *function_name, char *file_name, int line_number);
+struct cn_error_message_stack {
+  const struct cn_error_message_info **entries;
+  size_t size;
+  size_t capacity;
+};
+
+extern struct cn_error_message_stack cn_error_msg_stack;
+
+void cn_grow_msg_info_stack(void);
+
+static inline void cn_push_msg_info(const struct cn_error_message_info *info) {
+  if (cn_error_msg_stack.size == cn_error_msg_stack.capacity) {
+    cn_grow_msg_info_stack();
+  }
+  cn_error_msg_stack.entries[cn_error_msg_stack.size++] = info;
+}
+
+static inline void cn_pop_msg_info(void) {
+  cn_error_msg_stack.size--;
+}
+
+#define cn_push_msg_info_at_(line, x)                                                    \
+  do {                                                                                   \
+    static const struct cn_error_message_info cn_msg_info_ = {                           \
+        __func__, __FILE__, line, x};                                                    \
+    cn_push_msg_info(&cn_msg_info_);                                                     \
+  } while (0)
 
 #define initialise_error_msg_info()                                                      \
-  initialise_error_msg_info_(__func__, __FILE__, __LINE__)
+  do {                                                                                   \
+    reset_error_msg_info();                                                              \
+    cn_push_msg_info_at_(__LINE__, NULL);                                                \
+  } while (0)
+
+void reset_error_msg_info(void);
+void free_error_msg_info(void);
+void print_error_msg_info(void);
 
-void reset_error_msg_info();
-void free_error_msg_info();
+#if defined(CN_LOGGING_LEVEL) && CN_LOGGING_LEVEL == 0
 
-/* TODO: Implement */
-/*struct cn_error_messages {
-    struct cn_error_message_info *top_level_error_msg_info;
-    struct cn_error_message_info *nested_error_msg_info;
-};*/
+/* Nothing is ever printed: don't record the context */
+#define update_cn_error_message_info(x) ((void)0)
+#define update_cn_error_message_info_access_check(x) ((void)0)
+#define cn_pop_msg_info() ((void)0)
 
-void update_error_message_info_(
-    const char *function_name, char *file_name, int line_number, char *cn_source_loc);
+#else
 
-void cn_pop_msg_info();
+#define update_cn_error_message_info(x) cn_push_msg_info_at_(__LINE__ + 1, x)
 
-#define update_cn_error_message_info(x)                                                  \
-  update_error_message_info_(__func__, __FILE__, __LINE__ + 1, x)
+#define update_cn_error_message_info_access_check(x) cn_push_msg_info_at_(__LINE__, x)
 
-#define update_cn_error_message_info_access_check(x)                                     \
-  update_error_message_info_(__func__, __FILE__, __LINE__, x)
+#endif
 
 /* Wrappers for C types */
 
@@ -147,6 +205,42 @@ void cn_postcondition_leak_check(void);
 void cn_loop_put_back_ownership(void);
 void cn_loop_leak_check_and_put_back_ownership(void);
 
+/* Sampled checking: with a sampling period N > 1 (set_cn_sampling_period, or
+   the CN_SAMPLING_PERIOD environment variable), each instrumented function
+   fully checks one call in N, counted per function. The other calls still
+   transfer ownership, which keeps the ghost state consistent, but skip the
+   ownership checks, assertions and leak checks. With CN_SAMPLING_STATS set in
+   the environment, the per-function counts are printed on exit. */
+
+struct cn_callsite_stats {
+  const char *function_name;
+  const char *file_name;
+  int line_number;
+  unsigned long calls;
+  unsigned long checked;
+  struct cn_callsite_stats *next;
+};
+
+extern _Bool cn_checking_enabled;
+
+void set_cn_sampling_period(unsigned long period);
+unsigned long get_cn_sampling_period(void);
+
+/* Returns whether the caller was being checked, to be restored on exit */
+_Bool cn_sampled_call_enter(struct cn_callsite_stats *site);
+
+static inline void cn_sampled_call_exit(_Bool caller_checked) {
+  cn_checking_enabled = caller_checked;
+}
+
+void cn_print_sampling_stats(FILE *out);
+
+#define CN_SAMPLED_CALL_ENTER()                                                          \
+  static struct cn_callsite_stats __cn_callsite = {__func__, __FILE__, __LINE__};        \
+  _Bool __cn_caller_checked = cn_sampled_call_enter(&__cn_callsite)
+
+#define CN_SAMPLED_CALL_EXIT() cn_sampled_call_exit(__cn_caller_checked)
+
 /* malloc, free */
 void *cn_aligned_alloc(size_t align, size_t size);
 void *cn_malloc(unsigned long size);
@@ -575,6 +669,7 @@ static inline void cn_postfix(void *ptr, size_t size) {
     update_cn_error_message_info_access_check(NULL);                                     \
     c_ownership_check(                                                                   \
         "Load", (uintptr_t)__tmp, sizeof(typeof(LV)), get_cn_stack_depth());             \
+    cn_pop_msg_info();                                                                   \
     cn_load(__tmp, sizeof(typeof(LV)));                                                  \
     *__tmp;                                                                              \
   })
@@ -586,6 +681,7 @@ static inline void cn_postfix(void *ptr, size_t size) {
     update_cn_error_message_info_access_check(NULL);                                     \
     c_ownership_check(                                                                   \
         "Store", (uintptr_t)__tmp, sizeof(typeof(LV)), get_cn_stack_depth());            \
+    cn_pop_msg_info();                                                                   \
     cn_store(__tmp, sizeof(typeof(LV)));                                                 \
     *__tmp op## = (X);                                                                   \
   })
@@ -601,6 +697,7 @@ static inline void cn_postfix(void *ptr, size_t size) {
         (uintptr_t)__tmp,                                                                \
         sizeof(typeof(LV)),                                                              \
         get_cn_stack_depth());                                                           \
+    cn_pop_msg_info();                                                                   \
     cn_postfix(__tmp, sizeof(typeof(LV)));                                               \
     (*__tmp) OP;                                                                         \
   })
@@ -7,12 +7,14 @@ typedef hash_table ownership_ghost_state;
 /* Ownership globals */
 ownership_ghost_state* cn_ownership_global_ghost_state;
 
-struct cn_error_message_info* error_msg_info;
+struct cn_error_message_stack cn_error_msg_stack;
 
 signed long cn_stack_depth;
 
 signed long nr_owned_predicates;
 
+_Bool cn_checking_enabled = 1;
+
 void reset_fulminate(void) {
   cn_bump_free_all();
   cn_fl_free_all();
@@ -71,7 +73,7 @@ enum cn_trace_granularity set_cn_trace_granularity(
   return old_granularity;
 }
 
-void print_error_msg_info_single(struct cn_error_message_info* info) {
+void print_error_msg_info_single(const struct cn_error_message_info* info) {
   cn_printf(CN_LOGGING_ERROR,
       "function %s, file %s, line %d\n",
       info->function_name,
@@ -82,31 +84,30 @@ void print_error_msg_info_single(struct cn_error_message_info* info) {
   }
 }
 
-void print_error_msg_info(struct cn_error_message_info* info) {
-  if (info) {
-    enum cn_trace_granularity granularity = get_cn_trace_granularity();
-    if (granularity != CN_TRACE_NONE && info->parent != NULL) {
-      struct cn_error_message_info* curr = info;
-      while (curr->parent != NULL) {
-        curr = curr->parent;
-      }
-
+void print_error_msg_info(void) {
+  size_t size = cn_error_msg_stack.size;
+  const struct cn_error_message_info** entries = cn_error_msg_stack.entries;
+  if (CN_CURRENT_LOGGING_LEVEL() < CN_LOGGING_ERROR) {
+    // the context may not have been recorded (CN_LOGGING_LEVEL=0)
+    return;
+  }
+  if (size > 0) {
+    enum cn_trace_granularity granularity = CN_CURRENT_TRACE_GRANULARITY();
+    if (granularity != CN_TRACE_NONE && size > 1) {
       cn_printf(CN_LOGGING_ERROR,
           "********************* Originated from **********************\n");
-      print_error_msg_info_single(curr);
-      curr = curr->child;
+      print_error_msg_info_single(entries[0]);
 
-      while (granularity > CN_TRACE_ENDS && curr->child != NULL) {
+      for (size_t i = 1; granularity > CN_TRACE_ENDS && i < size - 1; i++) {
         cn_printf(CN_LOGGING_ERROR,
             "************************************************************\n");
-        print_error_msg_info_single(curr);
-        curr = curr->child;
+        print_error_msg_info_single(entries[i]);
       }
     }
 
     cn_printf(CN_LOGGING_ERROR,
         "************************ Failed at *************************\n");
-    print_error_msg_info_single(info);
+    print_error_msg_info_single(entries[size - 1]);
   } else {
     cn_printf(CN_LOGGING_ERROR, "Internal error: no error_msg_info available.");
     exit(SIGABRT);
@@ -127,8 +128,8 @@ _Bool convert_from_cn_bool(cn_bool* b) {
 
 void cn_assert(cn_bool* cn_b) {
   // cn_printf(CN_LOGGING_INFO, "[CN: assertion] function %s, file %s, line %d\n", error_msg_info.function_name, error_msg_info.file_name, error_msg_info.line_number);
-  if (!(cn_b->val)) {
-    print_error_msg_info(error_msg_info);
+  if (cn_checking_enabled && !(cn_b->val)) {
+    print_error_msg_info();
     cn_failure(CN_FAILURE_ASSERT);
   }
 }
@@ -215,6 +216,9 @@ void ghost_stack_depth_decr(void) {
 }
 
 void cn_postcondition_leak_check(void) {
+  if (!cn_checking_enabled) {
+    return;
+  }
   // leak checking
   hash_table_iterator it = ht_iterator(cn_ownership_global_ghost_state);
   // cn_printf(CN_LOGGING_INFO, "CN pointers leaked at (%ld) stack-depth: ", cn_stack_depth);
@@ -222,7 +226,7 @@ void cn_postcondition_leak_check(void) {
     uintptr_t* key = (uintptr_t*)it.key;
     int* depth = it.value;
     if (*depth > cn_stack_depth) {
-      print_error_msg_info(error_msg_info);
+      print_error_msg_info();
       cn_printf(CN_LOGGING_ERROR,
           "Postcondition leak check failed, ownership leaked for pointer " FMT_PTR "\n",
           *key);
@@ -233,6 +237,9 @@ void cn_postcondition_leak_check(void) {
 }
 
 void cn_loop_leak_check(void) {
+  if (!cn_checking_enabled) {
+    return;
+  }
   hash_table_iterator it = ht_iterator(cn_ownership_global_ghost_state);
 
   while (ht_next(&it)) {
@@ -240,7 +247,7 @@ void cn_loop_leak_check(void) {
     int* depth = it.value;
     /* Everything mapped to the function stack depth should have been bumped up by calls to Owned in invariant */
     if (*depth == cn_stack_depth - 1) {
-      print_error_msg_info(error_msg_info);
+      print_error_msg_info();
       cn_printf(CN_LOGGING_ERROR,
           "Loop invariant leak check failed, ownership leaked for pointer " FMT_PTR "\n",
           *key);
@@ -361,13 +368,16 @@ void c_ownership_check(char* access_kind,
     uintptr_t generic_c_ptr,
     int offset,
     signed long expected_stack_depth) {
+  if (!cn_checking_enabled) {
+    return;
+  }
   signed long address_key = 0;
   // cn_printf(CN_LOGGING_INFO, "C: Checking ownership for [ " FMT_PTR " .. " FMT_PTR " ] -- ", generic_c_ptr, generic_c_ptr + offset);
   for (int i = 0; i < offset; i++) {
     address_key = generic_c_ptr + i;
     int curr_depth = ownership_ghost_state_get(&address_key);
     if (curr_depth != expected_stack_depth) {
-      print_error_msg_info(error_msg_info);
+      print_error_msg_info();
       cn_printf(CN_LOGGING_ERROR, "%s failed.\n", access_kind);
       if (curr_depth == -1) {
         cn_printf(CN_LOGGING_ERROR,
@@ -514,55 +524,26 @@ void* convert_from_cn_pointer(cn_pointer* cn_ptr) {
   return cn_ptr->ptr;
 }
 
-struct cn_error_message_info* make_error_message_info_entry(const char* function_name,
-    char* file_name,
-    int line_number,
-    char* cn_source_loc,
-    struct cn_error_message_info* parent) {
-  struct cn_error_message_info* entry =
-      (struct cn_error_message_info*)cn_fl_malloc(sizeof(struct cn_error_message_info));
-  entry->function_name = function_name;
-  entry->file_name = file_name;
-  entry->line_number = line_number;
-  entry->cn_source_loc = cn_source_loc;
-  entry->parent = parent;
-  entry->child = NULL;
-  if (parent) {
-    parent->child = entry;
+/* The stack lives outside of the CN allocators, so that it survives
+   reset_fulminate() and is reused across runs. */
+void cn_grow_msg_info_stack(void) {
+  size_t capacity = cn_error_msg_stack.capacity ? 2 * cn_error_msg_stack.capacity : 256;
+  const struct cn_error_message_info** entries =
+      realloc(cn_error_msg_stack.entries, capacity * sizeof(*entries));
+  if (!entries) {
+    printf("Error message stack: out of memory\n");
+    exit(1);
   }
-  return entry;
+  cn_error_msg_stack.entries = entries;
+  cn_error_msg_stack.capacity = capacity;
 }
 
-void update_error_message_info_(
-    const char* function_name, char* file_name, int line_number, char* cn_source_loc) {
-  error_msg_info = make_error_message_info_entry(
-      function_name, file_name, line_number, cn_source_loc, error_msg_info);
+void reset_error_msg_info(void) {
+  cn_error_msg_stack.size = 0;
 }
 
-void initialise_error_msg_info_(
-    const char* function_name, char* file_name, int line_number) {
-  // cn_printf(CN_LOGGING_INFO, "Initialising error message info\n");
-  error_msg_info =
-      make_error_message_info_entry(function_name, file_name, line_number, 0, NULL);
-}
-
-void reset_error_msg_info() {
-  error_msg_info = NULL;
-}
-
-void free_error_msg_info() {
-  while (error_msg_info != NULL) {
-    cn_pop_msg_info();
-  }
-}
-
-void cn_pop_msg_info() {
-  struct cn_error_message_info* old = error_msg_info;
-  error_msg_info = old->parent;
-  if (error_msg_info) {
-    error_msg_info->child = NULL;
-  }
-  cn_fl_free(old);
+void free_error_msg_info(void) {
+  cn_error_msg_stack.size = 0;
 }
 
 static uint32_t cn_fls(uint32_t x) {
@@ -627,6 +608,61 @@ void cn_free_sized(void* malloced_ptr, size_t size) {
   c_remove_from_ghost_state((uintptr_t)malloced_ptr, size);
 }
 
+/* Sampled checking */
+
+static unsigned long sampling_period = 0;  // 0: not read from the environment yet
+
+static struct cn_callsite_stats* callsites = NULL;
+
+static void print_sampling_stats_at_exit(void) {
+  cn_print_sampling_stats(stderr);
+}
+
+unsigned long get_cn_sampling_period(void) {
+  if (sampling_period == 0) {
+    char* period = getenv("CN_SAMPLING_PERIOD");
+    sampling_period = period ? strtoul(period, NULL, 10) : 1;
+    if (sampling_period == 0) {
+      sampling_period = 1;
+    }
+    if (getenv("CN_SAMPLING_STATS")) {
+      atexit(print_sampling_stats_at_exit);
+    }
+  }
+  return sampling_period;
+}
+
+void set_cn_sampling_period(unsigned long period) {
+  get_cn_sampling_period();
+  sampling_period = period ? period : 1;
+}
+
+_Bool cn_sampled_call_enter(struct cn_callsite_stats* site) {
+  _Bool caller_checked = cn_checking_enabled;
+  unsigned long period = get_cn_sampling_period();
+  if (site->calls == 0) {
+    site->next = callsites;
+    callsites = site;
+  }
+  cn_checking_enabled = period == 1 || site->calls % period == 0;
+  site->calls++;
+  site->checked += cn_checking_enabled;
+  return caller_checked;
+}
+
+void cn_print_sampling_stats(FILE* out) {
+  fprintf(out, "function,file,line,calls,checked\n");
+  for (struct cn_callsite_stats* site = callsites; site != NULL; site = site->next) {
+    fprintf(out,
+        "%s,%s,%d,%lu,%lu\n",
+        site->function_name,
+        site->file_name,
+        site->line_number,
+        site->calls,
+        site->checked);
+  }
+}
+
 void cn_print_nr_owned_predicates(void) {
   printf("Owned predicates £%lu\n", nr_owned_predicates);
 }
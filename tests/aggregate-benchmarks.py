@@ -0,0 +1,134 @@
+#!/usr/bin/env python3
+
+# Aggregate the per-run `--bench-metrics` files written by run-ci-benchmarks.sh.
+#
+# Produces two files:
+#  - the dashboard file (github-action-benchmark "customSmallerIsBetter"
+#    format): median wall-clock time per test, with the spread across runs
+#    in "range", plus totals of the deterministic counters;
+#  - a details file with, for every test, the per-phase timing statistics
+#    and the counters of each run.
+
+import argparse
+import json
+import os
+import statistics
+import sys
+
+def load_runs(metrics_dir, index):
+    runs = []
+    prefix = "{}-".format(index)
+    for fname in sorted(os.listdir(metrics_dir)):
+        if fname.startswith(prefix) and fname.endswith(".json"):
+            with open(os.path.join(metrics_dir, fname), 'r') as f:
+                try:
+                    runs.append(json.load(f))
+                except json.JSONDecodeError:
+                    print("warning: ignoring malformed metrics file " + fname, file=sys.stderr)
+    return runs
+
+def stats(values):
+    if not values:
+        return None
+    return {
+        "median": statistics.median(values),
+        "min": min(values),
+        "max": max(values),
+        "stddev": statistics.stdev(values) if len(values) > 1 else 0.0,
+    }
+
+def run_wall(run):
+    # Sum of the top-level phases: nested phases are already included in
+    # their parents.
+    top = ["cpp", "parse", "desugar", "typing", "elaboration", "core_rewrites",
+           "core_to_mucore", "wf_check", "check_functions"]
+    return sum(run["phases"].get(p, {}).get("wall_s", 0.0) for p in top)
+
+def summarise(name, runs, times):
+    phases = {}
+    for run in runs:
+        for phase, m in run["phases"].items():
+            phases.setdefault(phase, {"wall_s": [], "cpu_s": [], "alloc_bytes": []})
+            for k in ("wall_s", "cpu_s", "alloc_bytes"):
+                phases[phase][k].append(m[k])
+    solver = [run["times"].get("solver", 0.0) for run in runs]
+    counters = [run["counters"] for run in runs]
+    allocated = [run["gc"]["allocated_bytes"] for run in runs]
+    return {
+        "name": name,
+        "runs": len(runs),
+        "time_s": stats(times),
+        "solver_s": stats(solver),
+        "phases": {p: {k: stats(v) for (k, v) in m.items()} for (p, m) in phases.items()},
+        "counters": counters[0] if counters else {},
+        "allocated_bytes": allocated[0] if allocated else 0,
+        # the counters only depend on the input and the binary: if repeated
+        # runs disagree, something non-deterministic is going on
+        "deterministic": all(c == counters[0] for c in counters)
+                         and all(a == allocated[0] for a in allocated),
+    }
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("--metrics-dir", required=True,
+                        help="directory of <index>-<run>.json metrics files")
+    parser.add_argument("--tests", required=True,
+                        help="file listing the test names, one per line, in index order")
+    parser.add_argument("--times", required=True,
+                        help="file of '<index> <seconds>' wall-clock samples")
+    parser.add_argument("--output", required=True, help="dashboard JSON file")
+    parser.add_argument("--details", required=True, help="per-phase details JSON file")
+    args = parser.parse_args()
+
+    with open(args.tests, 'r') as f:
+        tests = [line.strip() for line in f if line.strip()]
+
+    samples = {}
+    with open(args.times, 'r') as f:
+        for line in f:
+            index, value = line.split()
+            samples.setdefault(int(index), []).append(float(value))
+
+    output = []
+    details = []
+    total = 0.0
+    totals = {}
+    total_alloc = 0.0
+    for (index, name) in enumerate(tests):
+        runs = load_runs(args.metrics_dir, index)
+        times = samples.get(index, [])
+        if not times:
+            times = [run_wall(run) for run in runs]
+        summary = summarise(name, runs, times)
+        details.append(summary)
+        if summary["time_s"] is None:
+            continue
+        total += summary["time_s"]["median"]
+        for (counter, n) in summary["counters"].items():
+            totals[counter] = totals.get(counter, 0) + n
+        total_alloc += summary["allocated_bytes"]
+        output.append({
+            "name": name,
+            "unit": "Seconds",
+            "value": summary["time_s"]["median"],
+            "range": "± {:.3f}".format(summary["time_s"]["stddev"]),
+            "extra": "{} runs; min {:.3f}; max {:.3f}".format(
+                summary["runs"] or len(times), summary["time_s"]["min"], summary["time_s"]["max"]),
+        })
+
+    header = [{"name": "Total benchmark time", "unit": "Seconds", "value": total}]
+    for (counter, n) in totals.items():
+        header.append({"name": "Total " + counter, "unit": "Count", "value": n})
+    header.append({"name": "Total allocation", "unit": "MB", "value": total_alloc / 1e6})
+
+    with open(args.output, 'w') as f:
+        json.dump(header + output, f, indent=2)
+    with open(args.details, 'w') as f:
+        json.dump(details, f, indent=2)
+
+    nondet = [d["name"] for d in details if not d["deterministic"]]
+    if nondet:
+        print("warning: counters differ between runs of: " + ', '.join(nondet), file=sys.stderr)
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,6 @@
+#include <limits.h>
+int main(void)
+{
+  int x = INT_MIN;
+  return x / -1; // UNDEFINED: the quotient is not representable
+}
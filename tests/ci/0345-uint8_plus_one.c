@@ -0,0 +1,8 @@
+#include <stdint.h>
+int main(void)
+{
+  uint8_t c = 255;
+  int x = c + 1;     // promoted to int: 256
+  uint8_t d = c + 1; // converted back to uint8_t: 0
+  return x + d + (uint8_t)(c + 2); // 257
+}
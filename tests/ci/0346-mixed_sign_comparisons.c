@@ -0,0 +1,9 @@
+int main(void)
+{
+  int i = -1;
+  unsigned int u = 0;
+  unsigned char c = 0;
+  // i is converted to unsigned int (UINT_MAX) in the first comparison, but
+  // c is promoted to int in the second
+  return (i < u) + 2 * (i < c) + 4 * (-1 < 0u) + 8 * (-1 < (unsigned char)0); // 10
+}
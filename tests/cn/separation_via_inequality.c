@@ -0,0 +1,16 @@
+// p and q are only related by inequalities on their addresses, which
+// together with the separation of the two cells are inconsistent
+void f(int *p, int *q)
+/*@
+requires
+    take P = RW<int>(p);
+    take Q = RW<int>(q);
+    (u64) p <= (u64) q;
+    (u64) q <= (u64) p;
+ensures
+    take P2 = RW<int>(p);
+    take Q2 = RW<int>(q);
+@*/
+{
+  /*@ assert (false); @*/
+}
@@ -4,13 +4,45 @@ import json
 import sys
 import tabulate
 
-# Warn if the new code exceeds this percentage threshold of slowdown.
+# Warn if the new code exceeds this percentage threshold of slowdown, for
+# timings recorded without noise information (single runs).
 THRESHOLD = 150 # 2.5x slowdown
 
+# For timings with a spread ("range": "± stddev", see aggregate-benchmarks.py),
+# warn when the slowdown exceeds NOISE_FACTOR combined standard deviations and
+# is at least MIN_PERCENT.
+NOISE_FACTOR = 3
+MIN_PERCENT = 10
+
+# Deterministic counters (anything not measured in seconds) do not depend on
+# the machine, so even small increases are real.
+COUNTER_THRESHOLD = 2
+
+def parse_range(benchmark):
+    r = benchmark.get('range')
+    if not r:
+        return None
+    try:
+        return float(r.replace('±', '').strip())
+    except ValueError:
+        return None
+
+def is_regression(benchmark, baseline_value, new_value, new_range, percentage):
+    if benchmark.get('unit', 'Seconds') != 'Seconds':
+        return percentage > COUNTER_THRESHOLD
+    base_range = parse_range(benchmark)
+    if base_range is None or new_range is None:
+        return percentage > THRESHOLD
+    noise = NOISE_FACTOR * (base_range + new_range)
+    return percentage > MIN_PERCENT and (new_value - baseline_value) > noise
+
 def to_diff(new_value, baseline_value):
     diff = new_value - baseline_value
 
-    percent = (new_value / baseline_value - 1) * 100
+    if baseline_value == 0:
+        percent = 0 if new_value == 0 else float('inf')
+    else:
+        percent = (new_value / baseline_value - 1) * 100
     output = "{diff:+.2f} ({percent:+.2f}%)".format(diff=diff, percent=percent)
 
     return (output, percent)
@@ -25,8 +57,12 @@ def main():
         new_data = json.load(f)
     
     new_numbers = {}
+    new_ranges = {}
+    new_units = {}
     for benchmark in new_data:
         new_numbers[benchmark['name']] = benchmark['value']
+        new_ranges[benchmark['name']] = parse_range(benchmark)
+        new_units[benchmark['name']] = benchmark.get('unit', 'Seconds')
     
     with open(sys.argv[1], 'r') as f:
         baseline = json.load(f)
@@ -40,14 +76,17 @@ def main():
     for benchmark in baseline:
         name = benchmark['name']
         baseline_value = benchmark['value']
-        baseline_total += baseline_value
+        is_time = benchmark.get('unit', 'Seconds') == 'Seconds'
+        if is_time:
+            baseline_total += baseline_value
     
         new_value_m = new_numbers.get(name)
-        if new_value_m:
-            new_total += new_value_m
+        if new_value_m is not None:
+            if is_time:
+                new_total += new_value_m
             (diff, percentage) = to_diff(new_value_m, baseline_value)
 
-            if percentage > THRESHOLD:
+            if is_regression(benchmark, baseline_value, new_value_m, new_ranges.get(name), percentage):
                 disp_name = "**" + name + "***"
                 degradation.add(name)
             else:
@@ -63,7 +102,8 @@ def main():
         new_value = new_numbers[name]
         output.append([name, "-", new_value, "-"])
 
-        new_total += new_value
+        if new_units[name] == 'Seconds':
+            new_total += new_value
 
     (total_diff, _) = to_diff(new_total, baseline_total)
     output.append(["**Total runtime**", baseline_total, new_total, total_diff])
@@ -80,7 +120,7 @@ def main():
     print("\n# Benchmark comparison\n")
     
     # Benchmark name | Old time (s) | New time (s) | Difference (s)
-    print(tabulate.tabulate(output, headers=['Benchmark name', 'Baseline time (s)', 'New time (s)', 'Difference (s)'], tablefmt='pipe'))
+    print(tabulate.tabulate(output, headers=['Benchmark name', 'Baseline', 'New', 'Difference'], tablefmt='pipe'))
 
 if __name__ == "__main__":
     main()
@@ -2,68 +2,51 @@
 set -euo pipefail -o noclobber
 # set -xv # uncomment to debug variables
 
+# Number of runs of each benchmark (used for the noise statistics).
+REPEAT="${REPEAT:-3}"
+
 if [[ -z "${SOLVER+x}" ]]; then
   JSON_FILE="benchmark-data.json"
+  DETAILS_FILE="benchmark-details.json"
   SOLVER_TYPE="--solver-type=z3"
 else
   JSON_FILE="benchmark-data-${SOLVER}.json"
+  DETAILS_FILE="benchmark-details-${SOLVER}.json"
   SOLVER_TYPE="--solver-type=${SOLVER}"
 fi
-TMP_FILE=$(mktemp)
-
-echo "[" >> "${JSON_FILE}"
 
 DIRNAME=$(dirname "$0")
 
-TESTS=$(find "${DIRNAME}"/cn -name '*.c')
+WORK_DIR=$(mktemp -d -t 'cn-bench.XXXX')
+METRICS_DIR="${WORK_DIR}/metrics"
+mkdir "${METRICS_DIR}"
+TESTS_FILE="${WORK_DIR}/tests"
+TIMES_FILE="${WORK_DIR}/times"
+touch "${TESTS_FILE}" "${TIMES_FILE}"
 
-COUNT=0
-for TEST in ${TESTS}; do
-  let COUNT=${COUNT}+1
-done
+TESTS=$(find "${DIRNAME}"/cn -name '*.c')
 
 INDEX=0
-TOTAL=0
 for TEST in ${TESTS}; do
-
-  # Record wall clock time in seconds
-  /usr/bin/time --quiet -f "%e" -o /tmp/time cn verify "${SOLVER_TYPE}" "${TEST}" || true
-  TIME=$(cat /tmp/time)
-  TOTAL="$(echo "${TOTAL} + ${TIME}" | bc -l)"
-
-  # If we're last, don't print a trailing comma.
-  if [[ ${INDEX} -eq ${COUNT}-1 ]]; then
-    # Hack to output JSON.
-    cat << EOF >> "${TMP_FILE}"
-    {
-	"name": "${TEST}",
-        "unit": "Seconds",
-	"value": ${TIME}
-    }
-EOF
-  else
-    cat << EOF >> "${TMP_FILE}"
-    {
-	"name": "${TEST}",
-        "unit": "Seconds",
-	"value": ${TIME}
-    },
-EOF
-  fi
-
+  echo "${TEST}" >> "${TESTS_FILE}"
+  for RUN in $(seq 1 "${REPEAT}"); do
+    # Record wall clock time in seconds, along with the per-phase metrics
+    rm -f /tmp/time
+    /usr/bin/time --quiet -f "%e" -o /tmp/time \
+      cn verify "${SOLVER_TYPE}" --bench-metrics="${METRICS_DIR}/${INDEX}-${RUN}.json" "${TEST}" || true
+    echo "${INDEX} $(cat /tmp/time)" >> "${TIMES_FILE}"
+  done
   let INDEX=${INDEX}+1
 done
 
-cat << EOF >> "${JSON_FILE}"
-    {
-        "name": "Total benchmark time",
-        "unit": "Seconds",
-        "value": ${TOTAL}
-    },
-EOF
-
-cat "${TMP_FILE}" >> "${JSON_FILE}"
+rm -f "${JSON_FILE}" "${DETAILS_FILE}"
+"${DIRNAME}"/aggregate-benchmarks.py \
+  --metrics-dir "${METRICS_DIR}" \
+  --tests "${TESTS_FILE}" \
+  --times "${TIMES_FILE}" \
+  --output "${JSON_FILE}" \
+  --details "${DETAILS_FILE}"
 
-echo "]" >> "${JSON_FILE}"
+rm -rf "${WORK_DIR}"
 
 jq . "${JSON_FILE}"
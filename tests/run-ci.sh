@@ -68,6 +68,11 @@ else
   export CERB_RUNTIME=../runtime/
 fi
 
+# EVALUATOR=closure (or differential, to compare it with the reference driver)
+# selects the Core evaluator used for the executions
+# SWITCHES=switch1,... is passed to cerberus as --switches (the expected
+# outputs must not depend on it, e.g. with elide_range_checks)
+
 # Running ci tests
 for file in "${citests[@]}"
 do
@@ -83,9 +88,9 @@ do
   fi
 
   if [[ $file == *.syntax-only.c ]]; then
-    $CERB --nolibc --typecheck-core ci/$file > tmp/result 2> tmp/stderr
+    $CERB --nolibc --typecheck-core ${SWITCHES:+--switches=$SWITCHES} ci/$file > tmp/result 2> tmp/stderr
   else
-    $CERB --nolibc --typecheck-core --exec --batch ci/$file 1> tmp/result 2> tmp/stderr
+    $CERB --nolibc --typecheck-core --exec --batch ${EVALUATOR:+--evaluator=$EVALUATOR} ${SWITCHES:+--switches=$SWITCHES} ci/$file 1> tmp/result 2> tmp/stderr
   fi
   ret=$?;
   if [ -f ./ci/expected/$file.expected ]; then
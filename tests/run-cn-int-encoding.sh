@@ -0,0 +1,37 @@
+#!/usr/bin/env bash
+set -uo pipefail
+
+# Checks that `cn verify --solver-int-encoding` accepts and rejects the same
+# files in tests/cn as the default bit-vector encoding.
+
+function echo_and_err() {
+    printf "$1\n"
+    exit 1
+}
+
+[ $# -eq 0 ] || echo_and_err "USAGE: $0"
+
+cd "$(dirname "$0")/cn"
+
+FAILED=""
+
+for file in $(find . -maxdepth 1 -name '*.c' | sort); do
+  printf "[$file]... "
+  timeout 60 cn verify "$file" &> /dev/null
+  bits=$?
+  timeout 60 cn verify --solver-int-encoding "$file" &> /dev/null
+  ints=$?
+  if [ $bits -eq $ints ]; then
+    printf "\033[32mPASS\033[0m\n"
+  else
+    printf "\033[31mFAIL\033[0m (bit-vectors: $bits, integers: $ints)\n"
+    FAILED+=" $file"
+  fi
+done
+
+if [ -z "$FAILED" ]; then
+  exit 0
+else
+  printf "\033[31mFAILED: ${FAILED}\033[0m\n"
+  exit 1
+fi
@@ -206,6 +206,9 @@ citests=(
   0338-cast-pointer-to-_Bool.c
   0339-invalid-string-character.error.c
   0340-shl_promotion_to_signed.undef.c
+  0344-int_min_div_minus_one.undef.c
+  0345-uint8_plus_one.c
+  0346-mixed_sign_comparisons.c
 )
 
 # TESTS THAT ARE KNOW TO FAIL (for example .error test for which we need to improve the message)
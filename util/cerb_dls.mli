@@ -0,0 +1,13 @@
+(* Domain-local state. With OCaml 5 every domain has its own value for a key
+   (this is Domain.DLS); before OCaml 5 there is a single domain, and a key is
+   a mutable cell. *)
+type 'a key
+
+(* [init] computes the value of the key in a domain that has not set it. With
+   [~inherit:true], a domain instead starts with the value the key had in the
+   domain that spawned it, as for configurations which are set once at
+   startup. *)
+val new_key: ?inherit:bool -> (unit -> 'a) -> 'a key
+
+val get: 'a key -> 'a
+val set: 'a key -> 'a -> unit
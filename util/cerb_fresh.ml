@@ -1,10 +1,38 @@
+(* The numbers are unique across all the domains of the process, so that
+   symbols created in parallel never clash. *)
 let int : unit -> int =
-  let counter = ref (-1) in
+  let counter = Atomic.make (-1) in
   fun () ->
-    assert (!counter <> max_int);
-    incr counter; !counter
+    let n = Atomic.fetch_and_add counter 1 in
+    assert (n <> max_int);
+    n + 1
 
+(* The digest of the file a symbol comes from. Only the first 7 bytes of the
+   MD5 are kept, as a non-negative int, so that comparing (and hashing)
+   symbols is integer arithmetic. The bytes are taken big-endian, so that
+   digests are ordered as the full MD5s were (barring a collision of the
+   prefixes), and the value does not depend on the process, so that symbols
+   in marshalled core object files stay valid. *)
+type digest = int
+
+let digest_of_md5 (md5 : Digest.t) : digest =
+  let d = ref 0 in
+  for i = 0 to 6 do
+    d := (!d lsl 8) lor Char.code md5.[i]
+  done;
+  !d
+
+let string_of_digest (d : digest) =
+  Printf.sprintf "%014x" d
+
+(* the inverse of [string_of_digest] *)
+let digest_of_string (s : string) : digest =
+  int_of_string ("0x" ^ s)
+
+(* The digest of the file being processed is per domain (a domain starts with
+   the one of the domain that spawned it), so that several files can be
+   elaborated in parallel. *)
 let digest, set_digest =
-  let digest = ref "" in
-  (fun () -> !digest),
-  (fun filename -> digest := Digest.file filename)
\ No newline at end of file
+  let digest = Cerb_dls.new_key ~inherit:true (fun () -> 0) in
+  (fun () -> Cerb_dls.get digest),
+  (fun filename -> Cerb_dls.set digest (digest_of_md5 (Digest.file filename)))
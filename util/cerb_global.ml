@@ -29,8 +29,17 @@ type cerberus_conf = {
 
 let (!!) z = !z()
 
-let cerb_conf =
-  ref (fun () -> failwith "cerb_conf is Undefined")
+(* per domain, a spawned domain starting with the configuration of its parent *)
+let cerb_conf : cerberus_conf option Cerb_dls.key =
+  Cerb_dls.new_key ~inherit:true (fun () -> None)
+
+let set_conf conf =
+  Cerb_dls.set cerb_conf (Some conf)
+
+let get_conf () =
+  match Cerb_dls.get cerb_conf with
+    | Some conf -> conf
+    | None -> failwith "cerb_conf is Undefined"
 
 let set_cerb_conf ~backend_name ~exec exec_mode ~concurrency error_verbosity ~defacto ~permissive ~agnostic ~ignore_bitfields =
   let exec_mode_opt = if exec then Some exec_mode else None in
@@ -40,34 +49,34 @@ let set_cerb_conf ~backend_name ~exec exec_mode ~concurrency error_verbosity ~de
   let conf =
     {backend_name; defacto; concurrency; error_verbosity; agnostic; ignore_bitfields; permissive; exec_mode_opt; n1570}
   in
-  cerb_conf := fun () -> conf
+  set_conf conf
 
 let backend_name () =
-  !!cerb_conf.backend_name
+  (get_conf ()).backend_name
 
 let concurrency_mode () =
-  !!cerb_conf.concurrency
+  (get_conf ()).concurrency
 
 let isDefacto () =
-  !!cerb_conf.defacto
+  (get_conf ()).defacto
 
 let isPermissive () =
-  !!cerb_conf.permissive
+  (get_conf ()).permissive
 
 let isAgnostic () =
-  !!cerb_conf.agnostic
+  (get_conf ()).agnostic
 
 let isIgnoreBitfields () =
-  !!cerb_conf.ignore_bitfields
+  (get_conf ()).ignore_bitfields
 
 let current_execution_mode () =
-  !!cerb_conf.exec_mode_opt
+  (get_conf ()).exec_mode_opt
 
 let verbose () =
-  !!cerb_conf.error_verbosity
+  (get_conf ()).error_verbosity
 
 let n1570 () =
-  !!cerb_conf.n1570
+  (get_conf ()).n1570
 
 let error ?(code = 1) msg =
   prerr_endline Cerb_colour.(ansi_format [Red] ("ERROR: " ^ msg));
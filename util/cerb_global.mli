@@ -23,7 +23,9 @@ type cerberus_conf = {
 
 val (!!): (unit -> 'a) ref -> 'a
 
-val cerb_conf: (unit -> cerberus_conf) ref
+(* The configuration is per domain: a domain starts with the configuration of
+   the domain that spawned it, and may then set its own. *)
+val set_conf: cerberus_conf -> unit
 
 val set_cerb_conf:
     backend_name:string ->
@@ -294,18 +294,20 @@ let to_json loc =
 open Cerb_colour
 
 let pp_location =
-  let last_pos = ref Lexing.dummy_pos in
+  (* per domain, as the positions printed in one domain are unrelated to
+     those printed in another *)
+  let last_pos = Cerb_dls.new_key (fun () -> Lexing.dummy_pos) in
   fun ?(clever = false) loc ->
   let string_of_pos p =
     let open Lexing in
     let ret =
-      if !last_pos.pos_fname <> p.pos_fname then
+      if (Cerb_dls.get last_pos).pos_fname <> p.pos_fname then
         p.pos_fname ^ ":" ^ string_of_int p.pos_lnum ^ ":" ^ string_of_int (p.pos_cnum - p.pos_bol)
-      else if !last_pos.pos_lnum <> p.pos_lnum then
+      else if (Cerb_dls.get last_pos).pos_lnum <> p.pos_lnum then
         "line:" ^ string_of_int p.pos_lnum ^ ":" ^ string_of_int (p.pos_cnum - p.pos_bol)
       else
         "col:" ^ string_of_int (p.pos_cnum - p.pos_bol) in
-    begin if clever then last_pos := p end;
+    begin if clever then Cerb_dls.set last_pos p end;
     ret in
   let aux_region start_p end_p cur =
     let mk_cursor_str () =
@@ -313,7 +315,7 @@ let pp_location =
         | NoCursor -> ""
         | PointCursor cursor_p -> " " ^ string_of_pos cursor_p
         | RegionCursor (b, e) -> " " ^ string_of_pos b ^ " - " ^ string_of_pos e in
-    if !last_pos.pos_fname = start_p.pos_fname &&
+    if (Cerb_dls.get last_pos).pos_fname = start_p.pos_fname &&
        start_p.pos_fname = end_p.pos_fname &&
        start_p.pos_lnum = end_p.pos_lnum
     then
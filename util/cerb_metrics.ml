@@ -0,0 +1,97 @@
+type phase = {
+  mutable calls: int;
+  mutable wall: float;
+  mutable cpu: float;
+  mutable alloc_bytes: float;
+}
+
+let enabled = ref false
+
+(* both tables remember the order in which their keys were first seen, so
+   that the output is stable across runs *)
+let phases : (string, phase) Hashtbl.t = Hashtbl.create 32
+let phase_order = ref []
+
+let counters : (string, int) Hashtbl.t = Hashtbl.create 32
+let counter_order = ref []
+
+let times : (string, float) Hashtbl.t = Hashtbl.create 8
+let time_order = ref []
+
+let reset () =
+  Hashtbl.reset phases;
+  Hashtbl.reset counters;
+  Hashtbl.reset times;
+  phase_order := [];
+  counter_order := [];
+  time_order := []
+
+let get_phase name =
+  match Hashtbl.find_opt phases name with
+    | Some p ->
+        p
+    | None ->
+        let p = { calls= 0; wall= 0.0; cpu= 0.0; alloc_bytes= 0.0 } in
+        Hashtbl.add phases name p;
+        phase_order := name :: !phase_order;
+        p
+
+let time_phase name f =
+  if not !enabled then
+    f ()
+  else begin
+    let p = get_phase name in
+    let wall0 = Unix.gettimeofday () in
+    let cpu0 = Sys.time () in
+    let alloc0 = Gc.allocated_bytes () in
+    Fun.protect f ~finally:begin fun () ->
+      p.calls <- p.calls + 1;
+      p.wall <- p.wall +. (Unix.gettimeofday () -. wall0);
+      p.cpu <- p.cpu +. (Sys.time () -. cpu0);
+      p.alloc_bytes <- p.alloc_bytes +. (Gc.allocated_bytes () -. alloc0)
+    end
+  end
+
+let add name n =
+  if !enabled then
+    match Hashtbl.find_opt counters name with
+      | Some m ->
+          Hashtbl.replace counters name (m + n)
+      | None ->
+          Hashtbl.add counters name n;
+          counter_order := name :: !counter_order
+
+let incr name =
+  add name 1
+
+let add_time name d =
+  if !enabled then
+    match Hashtbl.find_opt times name with
+      | Some d' ->
+          Hashtbl.replace times name (d' +. d)
+      | None ->
+          Hashtbl.add times name d;
+          time_order := name :: !time_order
+
+let to_json () : Yojson.Safe.t =
+  let ordered order tbl f =
+    List.rev_map (fun name -> (name, f (Hashtbl.find tbl name))) !order in
+  let json_of_phase p =
+    `Assoc [ ("calls", `Int p.calls)
+           ; ("wall_s", `Float p.wall)
+           ; ("cpu_s", `Float p.cpu)
+           ; ("alloc_bytes", `Float p.alloc_bytes) ] in
+  let gc = Gc.quick_stat () in
+  `Assoc [ ("phases", `Assoc (ordered phase_order phases json_of_phase))
+         ; ("times", `Assoc (ordered time_order times (fun d -> `Float d)))
+         ; ("counters", `Assoc (ordered counter_order counters (fun n -> `Int n)))
+         ; ("gc", `Assoc [ ("allocated_bytes", `Float (Gc.allocated_bytes ()))
+                         ; ("minor_collections", `Int gc.Gc.minor_collections)
+                         ; ("major_collections", `Int gc.Gc.major_collections)
+                         ; ("top_heap_words", `Int gc.Gc.top_heap_words) ]) ]
+
+let output_file filename =
+  let oc = open_out filename in
+  Yojson.Safe.pretty_to_channel oc (to_json ());
+  output_char oc '\n';
+  close_out oc
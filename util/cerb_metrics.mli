@@ -0,0 +1,29 @@
+(* Benchmarking metrics: per-phase timings and deterministic counters.
+
+   Nothing is recorded unless [enabled] is set, so the instrumentation points
+   can stay in the pipelines permanently. Timings (wall clock and CPU time)
+   are noisy; the counters (allocated bytes, SMT queries, resource inference
+   steps, ...) only depend on the input and the binary, which makes them the
+   stable signal for regression tracking. *)
+
+val enabled: bool ref
+
+(* [time_phase name f] runs [f ()], accumulating its wall clock time, CPU time
+   and allocated bytes under [name]. Nested phases are allowed: the outer
+   phase includes the cost of the inner ones. *)
+val time_phase: string -> (unit -> 'a) -> 'a
+
+(* Bump a deterministic counter. *)
+val incr: string -> unit
+val add: string -> int -> unit
+
+(* Accumulate a duration (in seconds) measured by the caller, e.g. the time
+   spent waiting for the SMT solver. *)
+val add_time: string -> float -> unit
+
+val reset: unit -> unit
+
+val to_json: unit -> Yojson.Safe.t
+
+(* Write the JSON summary of everything recorded so far to a file. *)
+val output_file: string -> unit